@@ -372,26 +372,38 @@
   Square(a1, _j, _1); \
   Two_Two_Sum(_j, _1, _l, _2, x5, x4, x3, x2)
 
+// All variables below are set by exactinit().  They are thread-local, so
+//   that several meshes (with different bounding boxes and options) can be
+//   generated concurrently, each in its own thread.
+
 /* splitter = 2^ceiling(p / 2) + 1.  Used to split floats in half.           */
-static REAL splitter;
-static REAL epsilon;         /* = 2^(-p).  Used to estimate roundoff errors. */
+static thread_local REAL splitter;
+/* epsilon = 2^(-p).  Used to estimate roundoff errors.                      */
+static thread_local REAL epsilon;
 /* A set of coefficients used to calculate maximum roundoff errors.          */
-static REAL resulterrbound;
-static REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
-static REAL o3derrboundA, o3derrboundB, o3derrboundC;
-static REAL iccerrboundA, iccerrboundB, iccerrboundC;
-static REAL isperrboundA, isperrboundB, isperrboundC;
+static thread_local REAL resulterrbound;
+static thread_local REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
+static thread_local REAL o3derrboundA, o3derrboundB, o3derrboundC;
+static thread_local REAL iccerrboundA, iccerrboundB, iccerrboundC;
+static thread_local REAL isperrboundA, isperrboundB, isperrboundC;
 
 // Options to choose types of geometric computtaions. 
 // Added by H. Si, 2012-08-23.
-static int  _use_inexact_arith; // -X option.
-static int  _use_static_filter; // Default option, disable it by -X1
+static thread_local int  _use_inexact_arith; // -X option.
+static thread_local int  _use_static_filter; // Default option, disable it by -X1
 
 // Static filters for orient3d() and insphere(). 
 // They are pre-calcualted and set in exactinit().
 // Added by H. Si, 2012-08-23.
-static REAL o3dstaticfilter;
-static REAL ispstaticfilter;
+static thread_local REAL o3dstaticfilter;
+static thread_local REAL ispstaticfilter;
+
+// The calls of orient3d(), insphere() and orient4d() on this thread, each
+//   followed by the number of them decided by exact arithmetic.  They are
+//   never reset, and only counted while _count_predicates is set, see
+//   predicatecounts() and setpredicatecounting().
+static thread_local long predicatecount[6];
+static thread_local int  _count_predicates;
 
 
 
@@ -2178,6 +2190,7 @@ REAL orient3dadapt(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL permanent)
 
 REAL orient3d(REAL *pa, REAL *pb, REAL *pc, REAL *pd)
 {
+  if (_count_predicates) predicatecount[0]++;
   return (REAL) 
     - cgal_pred_obj.orientation_3_object()
         (Point(pa[0], pa[1], pa[2]), 
@@ -2194,6 +2207,7 @@ REAL orient3d(REAL *pa, REAL *pb, REAL *pc, REAL *pd)
   REAL bdxcdy, cdxbdy, cdxady, adxcdy, adxbdy, bdxady;
   REAL det;
 
+  if (_count_predicates) predicatecount[0]++;
 
   adx = pa[0] - pd[0];
   ady = pa[1] - pd[1];
@@ -2239,6 +2253,7 @@ REAL orient3d(REAL *pa, REAL *pb, REAL *pc, REAL *pd)
     return det;
   }
 
+  if (_count_predicates) predicatecount[1]++;
   return orient3dadapt(pa, pb, pc, pd, permanent);
 }
 
@@ -4033,6 +4048,7 @@ REAL insphereadapt(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe,
 
 REAL insphere(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe)
 {
+  if (_count_predicates) predicatecount[2]++;
   return (REAL)
     - cgal_pred_obj.side_of_oriented_sphere_3_object()
         (Point(pa[0], pa[1], pa[2]),
@@ -4056,6 +4072,7 @@ REAL insphere(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe)
   REAL abc, bcd, cda, dab;
   REAL det;
 
+  if (_count_predicates) predicatecount[2]++;
 
   aex = pa[0] - pe[0];
   bex = pb[0] - pe[0];
@@ -4156,11 +4173,278 @@ REAL insphere(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe)
     return det;
   }
 
+  if (_count_predicates) predicatecount[3]++;
   return insphereadapt(pa, pb, pc, pd, pe, permanent);
 }
 
 #endif // #ifdef USE_CGAL_PREDICATES
 
+/*****************************************************************************/
+/*                                                                           */
+/*  orient3d_batch()   orient3d(pa[i], pb[i], pc[i], pd) for i < n.          */
+/*  insphere_batch()   insphere(pa[i], pb[i], pc[i], pd[i], pe) for i < n.   */
+/*                                                                           */
+/*               The determinants of the static filter are evaluated for     */
+/*               4 (AVX) or 8 (AVX-512) queries at once, with the same       */
+/*               operations in the same order as the scalar routines, and    */
+/*               only the queries the filter can not decide go to the        */
+/*               scalar routines and their exact adaptive fallback.  The     */
+/*               results are identical to calling the scalar routines one    */
+/*               by one, which is what is done on other CPUs.                */
+/*                                                                           */
+/*****************************************************************************/
+
+#if !defined(USE_CGAL_PREDICATES) && !defined(SINGLE) && \
+    defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_PREDICATES_SIMD
+#endif
+
+#ifdef BATCH_PREDICATES_SIMD
+
+typedef double v4df __attribute__((vector_size(32)));
+typedef double v8df __attribute__((vector_size(64)));
+
+// The lanes of one batch, inlined into the kernels below which select the
+//   instruction set.  The kernels disable the contraction to fused
+//   multiply-adds, which would round differently from the scalar code.  The
+//   scalar code must be built with -ffp-contract=off as well (CMakeLists.txt
+//   does so), or -march=native/-mfma would let it contract.
+template <typename vec, int W>
+static inline __attribute__((always_inline))
+void orient3d_lanes(REAL **pa, REAL **pb, REAL **pc, REAL *pd, vec &det)
+{
+  vec adx, bdx, cdx, ady, bdy, cdy, adz, bdz, cdz;
+  int k;
+
+  for (k = 0; k < W; k++) {
+    adx[k] = pa[k][0]; ady[k] = pa[k][1]; adz[k] = pa[k][2];
+    bdx[k] = pb[k][0]; bdy[k] = pb[k][1]; bdz[k] = pb[k][2];
+    cdx[k] = pc[k][0]; cdy[k] = pc[k][1]; cdz[k] = pc[k][2];
+  }
+  adx -= pd[0]; ady -= pd[1]; adz -= pd[2];
+  bdx -= pd[0]; bdy -= pd[1]; bdz -= pd[2];
+  cdx -= pd[0]; cdy -= pd[1]; cdz -= pd[2];
+
+  det = adz * (bdx * cdy - cdx * bdy)
+      + bdz * (cdx * ady - adx * cdy)
+      + cdz * (adx * bdy - bdx * ady);
+}
+
+template <typename vec, int W>
+static inline __attribute__((always_inline))
+void insphere_lanes(REAL **pa, REAL **pb, REAL **pc, REAL **pd, REAL *pe,
+                    vec &det)
+{
+  vec aex, bex, cex, dex, aey, bey, cey, dey, aez, bez, cez, dez;
+  vec ab, bc, cd, da, ac, bd;
+  vec abc, bcd, cda, dab;
+  vec alift, blift, clift, dlift;
+  int k;
+
+  for (k = 0; k < W; k++) {
+    aex[k] = pa[k][0]; aey[k] = pa[k][1]; aez[k] = pa[k][2];
+    bex[k] = pb[k][0]; bey[k] = pb[k][1]; bez[k] = pb[k][2];
+    cex[k] = pc[k][0]; cey[k] = pc[k][1]; cez[k] = pc[k][2];
+    dex[k] = pd[k][0]; dey[k] = pd[k][1]; dez[k] = pd[k][2];
+  }
+  aex -= pe[0]; bex -= pe[0]; cex -= pe[0]; dex -= pe[0];
+  aey -= pe[1]; bey -= pe[1]; cey -= pe[1]; dey -= pe[1];
+  aez -= pe[2]; bez -= pe[2]; cez -= pe[2]; dez -= pe[2];
+
+  ab = aex * bey - bex * aey;
+  bc = bex * cey - cex * bey;
+  cd = cex * dey - dex * cey;
+  da = dex * aey - aex * dey;
+  ac = aex * cey - cex * aey;
+  bd = bex * dey - dex * bey;
+
+  abc = aez * bc - bez * ac + cez * ab;
+  bcd = bez * cd - cez * bd + dez * bc;
+  cda = cez * da + dez * ac + aez * cd;
+  dab = dez * ab + aez * bd + bez * da;
+
+  alift = aex * aex + aey * aey + aez * aez;
+  blift = bex * bex + bey * bey + bez * bez;
+  clift = cex * cex + cey * cey + cez * cez;
+  dlift = dex * dex + dey * dey + dez * dez;
+
+  det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+}
+
+// Batches of W lanes, then the rest and the undecided queries one by one.
+template <typename vec, int W>
+static inline __attribute__((always_inline))
+void orient3d_batch_w(int n, REAL **pa, REAL **pb, REAL **pc, REAL *pd,
+                      REAL *det)
+{
+  REAL filter = o3dstaticfilter;
+  long decided = 0;
+  int i, k;
+
+  for (i = 0; i + W <= n; i += W) {
+    vec d;
+    orient3d_lanes<vec, W>(pa + i, pb + i, pc + i, pd, d);
+    for (k = 0; k < W; k++) {
+      if ((d[k] > filter) || (d[k] < -filter)) {
+        det[i + k] = d[k];
+        decided++;
+      } else {
+        det[i + k] = orient3d(pa[i + k], pb[i + k], pc[i + k], pd);
+      }
+    }
+  }
+  for (; i < n; i++) {
+    det[i] = orient3d(pa[i], pb[i], pc[i], pd);
+  }
+  if (_count_predicates) predicatecount[0] += decided;
+}
+
+template <typename vec, int W>
+static inline __attribute__((always_inline))
+void insphere_batch_w(int n, REAL **pa, REAL **pb, REAL **pc, REAL **pd,
+                      REAL *pe, REAL *det)
+{
+  REAL filter = ispstaticfilter;
+  long decided = 0;
+  int i, k;
+
+  for (i = 0; i + W <= n; i += W) {
+    vec d;
+    insphere_lanes<vec, W>(pa + i, pb + i, pc + i, pd + i, pe, d);
+    for (k = 0; k < W; k++) {
+      if (fabs(d[k]) > filter) {
+        det[i + k] = d[k];
+        decided++;
+      } else {
+        det[i + k] = insphere(pa[i + k], pb[i + k], pc[i + k], pd[i + k], pe);
+      }
+    }
+  }
+  for (; i < n; i++) {
+    det[i] = insphere(pa[i], pb[i], pc[i], pd[i], pe);
+  }
+  if (_count_predicates) predicatecount[2] += decided;
+}
+
+__attribute__((target("avx"), optimize("fp-contract=off")))
+static void orient3d_batch_avx(int n, REAL **pa, REAL **pb, REAL **pc,
+                               REAL *pd, REAL *det)
+{
+  orient3d_batch_w<v4df, 4>(n, pa, pb, pc, pd, det);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void orient3d_batch_avx512(int n, REAL **pa, REAL **pb, REAL **pc,
+                                  REAL *pd, REAL *det)
+{
+  orient3d_batch_w<v8df, 8>(n, pa, pb, pc, pd, det);
+}
+
+__attribute__((target("avx"), optimize("fp-contract=off")))
+static void insphere_batch_avx(int n, REAL **pa, REAL **pb, REAL **pc,
+                               REAL **pd, REAL *pe, REAL *det)
+{
+  insphere_batch_w<v4df, 4>(n, pa, pb, pc, pd, pe, det);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void insphere_batch_avx512(int n, REAL **pa, REAL **pb, REAL **pc,
+                                  REAL **pd, REAL *pe, REAL *det)
+{
+  insphere_batch_w<v8df, 8>(n, pa, pb, pc, pd, pe, det);
+}
+
+// The number of lanes the CPU supports, 1 for the scalar routines.
+static int batch_width()
+{
+  static const int width = __builtin_cpu_supports("avx512f") ? 8 :
+                           __builtin_cpu_supports("avx") ? 4 : 1;
+  return width;
+}
+
+#endif // #ifdef BATCH_PREDICATES_SIMD
+
+void orient3d_batch(int n, REAL **pa, REAL **pb, REAL **pc, REAL *pd,
+                    REAL *det)
+{
+  int i;
+
+#ifdef BATCH_PREDICATES_SIMD
+  // Without the static filter there is nothing to batch.
+  if (!_use_inexact_arith && _use_static_filter) {
+    int width = batch_width();
+    if ((width == 8) && (n >= 8)) {
+      orient3d_batch_avx512(n, pa, pb, pc, pd, det);
+      return;
+    }
+    if ((width >= 4) && (n >= 4)) {
+      orient3d_batch_avx(n, pa, pb, pc, pd, det);
+      return;
+    }
+  }
+#endif
+
+  for (i = 0; i < n; i++) {
+    det[i] = orient3d(pa[i], pb[i], pc[i], pd);
+  }
+}
+
+void insphere_batch(int n, REAL **pa, REAL **pb, REAL **pc, REAL **pd,
+                    REAL *pe, REAL *det)
+{
+  int i;
+
+#ifdef BATCH_PREDICATES_SIMD
+  if (!_use_inexact_arith && _use_static_filter) {
+    int width = batch_width();
+    if ((width == 8) && (n >= 8)) {
+      insphere_batch_avx512(n, pa, pb, pc, pd, pe, det);
+      return;
+    }
+    if ((width >= 4) && (n >= 4)) {
+      insphere_batch_avx(n, pa, pb, pc, pd, pe, det);
+      return;
+    }
+  }
+#endif
+
+  for (i = 0; i < n; i++) {
+    det[i] = insphere(pa[i], pb[i], pc[i], pd[i], pe);
+  }
+}
+
+/*****************************************************************************/
+/*                                                                           */
+/*  predicatecounts()   Copy the predicate counters of this thread.          */
+/*  addpredicatecounts()   Add the counters of another thread to this one.   */
+/*  setpredicatecounting()   Start (on = 1) or stop (on = 0) counting the    */
+/*                           predicate calls of this thread.                 */
+/*                                                                           */
+/*****************************************************************************/
+
+void predicatecounts(long *counts)
+{
+  int i;
+
+  for (i = 0; i < 6; i++) {
+    counts[i] = predicatecount[i];
+  }
+}
+
+void addpredicatecounts(const long *counts)
+{
+  int i;
+
+  for (i = 0; i < 6; i++) {
+    predicatecount[i] += counts[i];
+  }
+}
+
+void setpredicatecounting(int on)
+{
+  _count_predicates = on;
+}
+
 /*****************************************************************************/
 /*                                                                           */
 /*  orient4d()   Return a positive value if the point pe lies above the      */
@@ -4614,6 +4898,7 @@ REAL orient4d(REAL* pa, REAL* pb, REAL* pc, REAL* pd, REAL* pe,
  REAL det;
  REAL permanent, errbound;
 
+ if (_count_predicates) predicatecount[4]++;
 
  aex = pa[0] - pe[0];
  bex = pb[0] - pe[0];
@@ -4696,6 +4981,7 @@ REAL orient4d(REAL* pa, REAL* pb, REAL* pc, REAL* pd, REAL* pe,
    return det;
  }
 
+ if (_count_predicates) predicatecount[5]++;
  return orient4dadapt(pa, pb, pc, pd, pe,
                       aheight, bheight, cheight, dheight, eheight, permanent);
 }
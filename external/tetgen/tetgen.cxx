@@ -47,6 +47,16 @@
 
 #include "tetgen.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 //== io_cxx ==================================================================//
 //                                                                            //
 //                                                                            //
@@ -2976,6 +2986,9 @@ void tetgenbehavior::syntax()
   printf("    -i  Inserts a list of additional points.\n");
   printf("    -O  Specifies the level of mesh optimization.\n");
   printf("    -S  Specifies maximum number of added points.\n");
+  printf("    -j  Sorts and smooths on # threads (default all).\n");
+  printf("    -G  Starts point location from a grid of inserted points.\n");
+  printf("    -K  Uses compact records and large-page memory pools.\n");
   printf("    -T  Sets a tolerance for coplanar test (default 1e-8).\n");
   printf("    -X  Suppresses use of exact arithmetic.\n");
   printf("    -M  No merge of coplanar facets or very close vertices.\n");
@@ -3587,6 +3600,25 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
           workstring[k] = '\0';
           epsilon = (REAL) strtod(workstring, (char **) NULL);
         }
+      } else if (argv[i][j] == 'j') {
+        num_threads = (int) std::thread::hardware_concurrency();
+        if ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+          k = 0;
+          while ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+            j++;
+            workstring[k] = argv[i][j];
+            k++;
+          }
+          workstring[k] = '\0';
+          num_threads = (int) strtol(workstring, (char **) NULL, 0);
+        }
+        if (num_threads < 1) {
+          num_threads = 1;
+        }
+      } else if (argv[i][j] == 'G') {
+        locate_grid = 1;
+      } else if (argv[i][j] == 'K') {
+        compactmem = 1;
       } else if (argv[i][j] == 'C') {
         docheck++;
       } else if (argv[i][j] == 'Q') {
@@ -4169,12 +4201,13 @@ tetgenmesh::memorypool::memorypool()
   items = maxitems = 0l;
   unallocateditems = 0;
   pathitemsleft = 0;
+  largepages = 0;
 }
 
 tetgenmesh::memorypool::memorypool(int bytecount, int itemcount, int wsize, 
-                                   int alignment)
+                                   int alignment, int largepages)
 {
-  poolinit(bytecount, itemcount, wsize, alignment);
+  poolinit(bytecount, itemcount, wsize, alignment, largepages);
 }
 
 //============================================================================//
@@ -4206,10 +4239,17 @@ tetgenmesh::memorypool::~memorypool()
 // `alignment' is normally used to create a few unused bits at the bottom of  //
 // each item's pointer, in which information may be stored.                   //
 //                                                                            //
+// If `largepages' isn't zero, the blocks are whole multiples of 2MB aligned  //
+// to 2MB, so that the kernel can back them by huge pages, and `itemcount' is //
+// increased to fill them.                                                    //
+//                                                                            //
 //============================================================================//
 
+// The size of a large (huge) page.
+static const size_t largepagebytes = 2 * 1024 * 1024;
+
 void tetgenmesh::memorypool::poolinit(int bytecount,int itemcount,int wordsize,
-                                      int alignment)
+                                      int alignment, int largepages)
 {
   // Find the proper alignment, which must be at least as large as:
   //   - The parameter `alignment'.
@@ -4228,20 +4268,65 @@ void tetgenmesh::memorypool::poolinit(int bytecount,int itemcount,int wordsize,
             * (alignbytes / wordsize);
   itembytes = itemwords * wordsize;
   itemsperblock = itemcount;
-
-  // Allocate a block of items.  Space for `itemsperblock' items and one
-  //   pointer (to point to the next block) are allocated, as well as space
-  //   to ensure alignment of the items. 
-  firstblock = (void **) malloc(itemsperblock * itembytes + sizeof(void *)
-                                + alignbytes); 
-  if (firstblock == (void **) NULL) {
-    terminatetetgen(NULL, 1);
-  }
+  this->largepages = largepages;
+  if (largepages) {
+    // Round the block up to whole large pages.
+    size_t blockbytes = (size_t) itemsperblock * itembytes + sizeof(void *)
+                      + alignbytes;
+    blockbytes = (blockbytes + largepagebytes - 1) / largepagebytes
+               * largepagebytes;
+    itemsperblock = (int) ((blockbytes - sizeof(void *) - alignbytes)
+                           / itembytes);
+  }
+
+  // Allocate a block of items.
+  firstblock = (void **) allocblock();
   // Set the next block pointer to NULL.
   *(firstblock) = (void *) NULL;
   restart();
 }
 
+//============================================================================//
+//                                                                            //
+// allocblock()   Allocate a block of items.                                  //
+//                                                                            //
+// Space for `itemsperblock' items and one pointer (to point to the next      //
+// block) are allocated, as well as space to ensure alignment of the items.   //
+// Large-page blocks are advised to the kernel as huge page candidates, which //
+// saves TLB misses on big meshes. They are freed by free() as usual.         //
+//                                                                            //
+//============================================================================//
+
+void* tetgenmesh::memorypool::allocblock()
+{
+  size_t blockbytes = (size_t) itemsperblock * itembytes + sizeof(void *)
+                    + alignbytes;
+  void *newblock = NULL;
+
+  if (largepages) {
+    blockbytes = (blockbytes + largepagebytes - 1) / largepagebytes
+               * largepagebytes;
+#ifdef __linux__
+    if (posix_memalign(&newblock, largepagebytes, blockbytes) != 0) {
+      newblock = NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (newblock != NULL) {
+      madvise(newblock, blockbytes, MADV_HUGEPAGE);
+    }
+#endif
+#else
+    newblock = malloc(blockbytes);
+#endif
+  } else {
+    newblock = malloc(blockbytes);
+  }
+  if (newblock == NULL) {
+    terminatetetgen(NULL, 1);
+  }
+  return newblock;
+}
+
 //============================================================================//
 //                                                                            //
 // restart()   Deallocate all items in this pool.                             //
@@ -4296,11 +4381,7 @@ void* tetgenmesh::memorypool::alloc()
       // Check if another block must be allocated.
       if (*nowblock == (void *) NULL) {
         // Allocate a new block of items, pointed to by the previous block.
-        newblock = (void **) malloc(itemsperblock * itembytes + sizeof(void *) 
-                                    + alignbytes);
-        if (newblock == (void **) NULL) {
-          terminatetetgen(NULL, 1);
-        }
+        newblock = (void **) allocblock();
         *nowblock = (void *) newblock;
         // The next block pointer is NULL.
         *newblock = (void *) NULL;
@@ -4831,7 +4912,10 @@ void tetgenmesh::initializepools()
     printf("  tetrahedron per block: %d.\n", b->tetrahedraperblock);
   }
 
-  inittables();
+  // The look-up tables are shared by all meshes.  Initialize them exactly
+  //   once, also when several meshes are created concurrently.
+  static bool tables_initialized = (inittables(), true);
+  (void) tables_initialized;
 
   // There are three input point lists available, which are in, addin,
   //   and bgm->in. These point lists may have different number of 
@@ -4930,10 +5014,16 @@ void tetgenmesh::initializepools()
   //   - an integer for boundary marker;
   //   - an integer for vertex type;
   //   - an integer for local index (for vertex insertion)
-  pointsize = (pointmarkindex + 3) * sizeof(tetrahedron);  
+  if (b->compactmem) { // -K
+    pointsize = (pointmarkindex + 3) * sizeof(int);
+  } else {
+    // The ints are counted in pointers, which leaves unused space.
+    pointsize = (pointmarkindex + 3) * sizeof(tetrahedron);  
+  }
 
   // Initialize the pool of vertices.
-  points = new memorypool(pointsize, b->vertexperblock, sizeof(REAL), 0);
+  points = new memorypool(pointsize, b->vertexperblock, sizeof(REAL), 0,
+                          b->compactmem);
 
   if (b->verbose) {
     printf("  Size of a point: %d bytes.\n", points->itembytes);
@@ -4981,8 +5071,10 @@ void tetgenmesh::initializepools()
   //     [7]  |_____ vertex p3 ____|
   //     [8]  |__ segments array __| (used by -p)
   //     [9]  |__ subfaces array __| (used by -p)
-  //    [10]  |_____ reserved _____|
+  //    [10]  |_____ reserved _____| (its first integer is the elem index)
   //    [11]  |___ elem marker ____| (used as an integer)
+  // With '-K' the element marker is the second integer of [10], and the
+  //   record ends there.
 
   elesize = 12 * sizeof(tetrahedron); 
 
@@ -4992,7 +5084,12 @@ void tetgenmesh::initializepools()
       ((sizeof(tetrahedron) % sizeof(int)))) {
     terminatetetgen(this, 2);
   }
-  elemmarkerindex = (elesize - sizeof(tetrahedron)) / sizeof(int);
+  if (b->compactmem && (sizeof(tetrahedron) >= 2 * sizeof(int))) { // -K
+    elesize = 11 * sizeof(tetrahedron);
+    elemmarkerindex = (10 * sizeof(tetrahedron)) / sizeof(int) + 1;
+  } else {
+    elemmarkerindex = (elesize - sizeof(tetrahedron)) / sizeof(int);
+  }
 
   // Let (cx, cy, cz) be the circumcenter of this element, r be the radius
   //   of the circumsphere, and V be the (positive) volume of this element.
@@ -5031,7 +5128,7 @@ void tetgenmesh::initializepools()
 
   // Having determined the memory size of an element, initialize the pool.
   tetrahedrons = new memorypool(elesize, b->tetrahedraperblock, sizeof(void *),
-                                16);
+                                16, b->compactmem);
 
   if (b->verbose) {
     printf("  Size of a tetrahedron: %d (%d) bytes.\n", elesize,
@@ -5059,12 +5156,17 @@ void tetgenmesh::initializepools()
     // Increase the number of bytes by two or three integers, one for facet
     //   marker, one for shellface type and flags, and optionally one
 	//   for storing facet index (for mesh refinement).
-    shsize = (shmarkindex + 2 + useinsertradius) * sizeof(shellface);
+    if (b->compactmem) { // -K
+      shsize = (shmarkindex + 3) * sizeof(int);
+    } else {
+      shsize = (shmarkindex + 2 + useinsertradius) * sizeof(shellface);
+    }
 
     // Initialize the pool of subfaces. Each subface record is eight-byte
     //   aligned so it has room to store an edge version (from 0 to 5) in
     //   the least three bits.
-    subfaces = new memorypool(shsize, b->shellfaceperblock, sizeof(void *), 8);
+    subfaces = new memorypool(shsize, b->shellfaceperblock, sizeof(void *), 8,
+                              b->compactmem);
 
     if (b->verbose) {
       printf("  Size of a shellface: %d (%d) bytes.\n", shsize,
@@ -5073,7 +5175,8 @@ void tetgenmesh::initializepools()
 
     // Initialize the pool of subsegments. The subsegment's record is same
     //   with subface.
-    subsegs = new memorypool(shsize, b->shellfaceperblock, sizeof(void *), 8);
+    subsegs = new memorypool(shsize, b->shellfaceperblock, sizeof(void *), 8,
+                             b->compactmem);
 
     // Initialize the pool for tet-subseg connections.
     tet2segpool = new memorypool(6 * sizeof(shellface), b->shellfaceperblock, 
@@ -9096,6 +9199,12 @@ int tetgenmesh::insertpoint(point insertpt, triface *searchtet, face *splitsh,
   bool enqflag;
   int t1ver;
   int i, j, k, s;
+  // In-sphere tests of the queued cavity tets, evaluated ahead in windows of
+  //   'bwwindow' list entries by insphere_batch().
+  const int bwwindow = 16;
+  point bpa[bwwindow], bpb[bwwindow], bpc[bwwindow], bpd[bwwindow];
+  REAL bdet[bwwindow];
+  int bidx[bwwindow], bbegin, bend, nbatch;
 
   if (b->verbose > 2) {
     printf("      Insert point %d\n", pointmark(insertpt));
@@ -9407,13 +9516,18 @@ int tetgenmesh::insertpoint(point insertpt, triface *searchtet, face *splitsh,
     // Assign mesh size for the new point.
     if (bgm != NULL) {
       // Interpolate the mesh size from the background mesh. 
-      bgm->decode(point2bgmtet(org(*searchtet)), neightet);
-      int bgmloc = (int) bgm->scout_point(insertpt, &neightet, 0);
+      int bgmloc = bgm->sizegrid_locate(insertpt, &neightet);
       if (bgmloc != (int) OUTSIDE) {
         insertpt[pointmtrindex] =  
           bgm->getpointmeshsize(insertpt, &neightet, bgmloc);
         setpoint2bgmtet(insertpt, bgm->encode(neightet));
       }
+    } else if ((in->meshsizefunc != NULL) || (in->meshsizegrid != NULL)) {
+      // Take the mesh size from the size field.
+      REAL size = getfieldmeshsize(insertpt);
+      if (size > 0.0) {
+        insertpt[pointmtrindex] = size;
+      }
     } else {
       insertpt[pointmtrindex] = getpointmeshsize(insertpt,searchtet,(int)loc);
     }
@@ -9424,9 +9538,32 @@ int tetgenmesh::insertpoint(point insertpt, triface *searchtet, face *splitsh,
     swaplist = cavetetlist;
     cavetetlist = cavebdrylist;
     cavebdrylist = swaplist;
+    bbegin = bend = 0;
     for (i = 0; i < cavetetlist->objects; i++) {
       // 'cavetet' is an adjacent tet at outside of the cavity.
       cavetet = (triface *) fastlookup(cavetetlist, i);
+      if (!b->weighted && (i >= bend)) {
+        // Test the volume tets queued from here on. The tests are pure, so
+        //   a tet which is included or tested meanwhile only wastes one.
+        bbegin = i;
+        bend = i + bwwindow;
+        if (bend > cavetetlist->objects) bend = cavetetlist->objects;
+        nbatch = 0;
+        for (j = bbegin; j < bend; j++) {
+          parytet = (triface *) fastlookup(cavetetlist, j);
+          pts = (point *) parytet->tet;
+          bidx[j - bbegin] = -1;
+          if (!infected(*parytet) && !marktested(*parytet) &&
+              (pts[7] != dummypoint)) {
+            bpa[nbatch] = pts[4];
+            bpb[nbatch] = pts[5];
+            bpc[nbatch] = pts[6];
+            bpd[nbatch] = pts[7];
+            bidx[j - bbegin] = nbatch++;
+          }
+        }
+        insphere_batch(nbatch, bpa, bpb, bpc, bpd, insertpt, bdet);
+      }
       // The tet may be tested and included in the (enlarged) cavity.
       if (!infected(*cavetet)) {
         // Check for two possible cases for this tet: 
@@ -9443,7 +9580,11 @@ int tetgenmesh::insertpoint(point insertpt, triface *searchtet, face *splitsh,
                                 pts[4][3], pts[5][3], pts[6][3], pts[7][3],
                                 insertpt[3]);
             } else {
-              sign = insphere_s(pts[4], pts[5], pts[6], pts[7], insertpt);
+              // insphere_s() perturbs the zero determinants only.
+              sign = (bidx[i - bbegin] >= 0) ? bdet[bidx[i - bbegin]] : 0.0;
+              if (sign == 0.0) {
+                sign = insphere_s(pts[4], pts[5], pts[6], pts[7], insertpt);
+              }
             }
             enqflag = (sign < 0.0);
           } else {
@@ -10774,7 +10915,7 @@ void tetgenmesh::transfernodes()
   exactinit(b->verbose, b->noexact, b->nostaticfilter, x, y, z);
 
   // Use the number of points as the random seed.
-  srand(in->numberofpoints);
+  randomintseed = in->numberofpoints;
 
   // 'longest' is the largest possible edge length formed by input vertices.
   longest = sqrt(x * x + y * y + z * z);
@@ -10861,6 +11002,101 @@ void tetgenmesh::hilbert_init(int n)
   }
 }
 
+//============================================================================//
+//                                                                            //
+// walltime()    Return the wall-clock time in seconds.                       //
+//                                                                            //
+// threadcputime()    Return the CPU time of the calling thread in seconds.   //
+//                                                                            //
+// Unlike clock(), which is the CPU time of the whole process, both stay      //
+// meaningful when several meshes or threads run at the same time.  Without   //
+// a thread CPU clock, the process CPU time is returned.                      //
+//                                                                            //
+//============================================================================//
+
+static REAL walltime()
+{
+  return std::chrono::duration<REAL>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static REAL threadcputime()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return (REAL) ts.tv_sec + (REAL) ts.tv_nsec * 1e-9;
+  }
+#endif
+  return (REAL) clock() / (REAL) CLOCKS_PER_SEC;
+}
+
+//============================================================================//
+//                                                                            //
+// runthreads()    Run work(t) for t = 0, ..., nthreads - 1 at the same time. //
+//                                                                            //
+// work(0) runs on the calling thread, the others on new threads. The         //
+// predicates keep their state per thread, so a new thread initializes it the //
+// same way transfernodes() did. An error thrown by terminatetetgen() on any  //
+// thread is thrown again on the calling thread after all threads are done.   //
+// The CPU time and predicate calls of the new threads are added to those of  //
+// the calling thread.                                                        //
+//                                                                            //
+//============================================================================//
+
+template <class Work>
+static void runthreads(tetgenmesh *m, int nthreads, Work work)
+{
+  int *errorcodes = new int[nthreads];
+  REAL *cputimes = new REAL[nthreads];
+  long (*counts)[6] = new long[nthreads][6];
+  REAL dx = m->xmax - m->xmin, dy = m->ymax - m->ymin, dz = m->zmax - m->zmin;
+  int t;
+
+  auto run = [&](int t) {
+    errorcodes[t] = 0;
+    if (t > 0) {
+      exactinit(0, m->b->noexact, m->b->nostaticfilter, dx, dy, dz);
+      setpredicatecounting(m->countpredicates);
+    }
+    try {
+      work(t);
+    } catch (int e) {
+      errorcodes[t] = e;
+    }
+    if (t > 0) {
+      cputimes[t] = threadcputime();
+      predicatecounts(counts[t]);
+    }
+  };
+
+  std::thread *workers = new std::thread[nthreads];
+  for (t = 1; t < nthreads; t++) {
+    workers[t] = std::thread(run, t);
+  }
+  run(0);
+  for (t = 1; t < nthreads; t++) {
+    workers[t].join();
+  }
+  delete [] workers;
+
+  for (t = 1; t < nthreads; t++) {
+    m->workercputime += cputimes[t];
+    addpredicatecounts(counts[t]);
+  }
+  delete [] cputimes;
+  delete [] counts;
+
+  int e = 0;
+  for (t = 0; t < nthreads && e == 0; t++) {
+    e = errorcodes[t];
+  }
+  delete [] errorcodes;
+  if (e != 0) {
+    terminatetetgen(m, e);
+  }
+}
+
 //============================================================================//
 //                                                                            //
 // hilbert_sort3()    Sort points using the 3d Hilbert curve.                 //
@@ -10938,13 +11174,19 @@ int tetgenmesh::hilbert_split(point* vertexarray,int arraysize,int gc0,int gc1,
   return i;
 }
 
+// Sub-boxes with more points than this are sorted on other threads.
+static const int hilbert_task_size = 8192;
+
 void tetgenmesh::hilbert_sort3(point* vertexarray, int arraysize, int e, int d, 
                                REAL bxmin, REAL bxmax, REAL bymin, REAL bymax, 
-                               REAL bzmin, REAL bzmax, int depth)
+                               REAL bzmin, REAL bzmax, int depth, int threads)
 {
   REAL x1, x2, y1, y2, z1, z2;
   int p[9], w, e_w, d_w, k, ei, di;
   int n = 3, mask = 7;
+  // The sub-boxes sorted on other threads, see below.
+  REAL subbox[8][6];
+  int subw[8], subei[8], subdi[8], nsub = 0;
 
   p[0] = 0;
   p[8] = arraysize;
@@ -11026,10 +11268,38 @@ void tetgenmesh::hilbert_sort3(point* vertexarray, int arraysize, int e, int d,
         z1 = bzmin;
         z2 = 0.5 * (bzmin + bzmax);
       }
-      hilbert_sort3(&(vertexarray[p[w]]), p[w+1] - p[w], ei, di, 
-                    x1, x2, y1, y2, z1, z2, depth+1);
+      if ((threads > 1) && ((p[w+1] - p[w]) > hilbert_task_size)) {
+        subw[nsub] = w;
+        subei[nsub] = ei;
+        subdi[nsub] = di;
+        subbox[nsub][0] = x1; subbox[nsub][1] = x2;
+        subbox[nsub][2] = y1; subbox[nsub][3] = y2;
+        subbox[nsub][4] = z1; subbox[nsub][5] = z2;
+        nsub++;
+      } else {
+        hilbert_sort3(&(vertexarray[p[w]]), p[w+1] - p[w], ei, di, 
+                      x1, x2, y1, y2, z1, z2, depth+1);
+      }
     } // if (p[w+1] - p[w] > 1)
   } // w
+
+  if (nsub > 0) {
+    // The sub-boxes are disjoint parts of the array. Threads take the next
+    //   one until all are sorted, and share the rest of the threads in the
+    //   deeper levels.
+    int nthreads = (nsub < threads) ? nsub : threads;
+    int subthreads = threads / nthreads;
+    std::atomic<int> next(0);
+    runthreads(this, nthreads, [&](int) {
+      int i, sw;
+      while ((i = next++) < nsub) {
+        sw = subw[i];
+        hilbert_sort3(&(vertexarray[p[sw]]), p[sw+1] - p[sw], subei[i], subdi[i],
+                      subbox[i][0], subbox[i][1], subbox[i][2], subbox[i][3],
+                      subbox[i][4], subbox[i][5], depth+1, subthreads);
+      }
+    });
+  }
 }
 
 //============================================================================//
@@ -11049,9 +11319,11 @@ void tetgenmesh::brio_multiscale_sort(point* vertexarray, int arraysize,
     middle = arraysize * ratio;
     brio_multiscale_sort(vertexarray, middle, threshold, ratio, depth);
   }
-  // Sort the right-array (rnd-th round) using the Hilbert curve.
+  // Sort the right-array (rnd-th round) using the Hilbert curve. With -j#
+  //   its sub-boxes are sorted on # threads.
   hilbert_sort3(&(vertexarray[middle]), arraysize - middle, 0, 0, // e, d
-                xmin, xmax, ymin, ymax, zmin, zmax, 0); // depth.
+                xmin, xmax, ymin, ymax, zmin, zmax, 0, // depth.
+                (b->num_threads > 0) ? b->num_threads : 1);
 }
 
 //============================================================================//
@@ -11079,6 +11351,23 @@ unsigned long tetgenmesh::randomnation(unsigned int choices)
   }
 }
 
+//============================================================================//
+//                                                                            //
+// randomint()    Generate a random integer in [0, 2^31).                     //
+//                                                                            //
+// It replaces the rand() of the C library, which keeps a state shared by all //
+// threads.  Each mesh has its own seed 'randomintseed', so the result of a   //
+// run is repeatable even if other meshes are generated at the same time.     //
+//                                                                            //
+//============================================================================//
+
+int tetgenmesh::randomint()
+{
+  randomintseed = randomintseed * 6364136223846793005ull
+                + 1442695040888963407ull;
+  return (int) (randomintseed >> 33);
+}
+
 //============================================================================//
 //                                                                            //
 // randomsample()    Randomly sample the tetrahedra for point loation.        //
@@ -11188,6 +11477,139 @@ void tetgenmesh::randomsample(point searchpt,triface *searchtet)
   }
 }
 
+//============================================================================//
+//                                                                            //
+// locgrid_init()    Create the grid of vertices seeding point location.      //
+//                                                                            //
+// With -G, incrementaldelaunay() keeps the last inserted vertex of each cell //
+// of a uniform grid over the bounding box, about 'npoints' / 4 cells. A walk //
+// then starts from the tet of the nearest of these vertices instead of the   //
+// most recent tet, which is far away when the points are not sorted.         //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::locgrid_init(int npoints)
+{
+  REAL size[3] = {xmax - xmin, ymax - ymin, zmax - zmin};
+  REAL maxsize = size[0];
+  long ncells;
+  int i;
+
+  for (i = 1; i < 3; i++) {
+    if (size[i] > maxsize) maxsize = size[i];
+  }
+  // Cubic cells of volume about 4 points, at least 1 cell thick on the flat
+  //   sides of the box.
+  for (i = 0; i < 3; i++) {
+    if (size[i] < maxsize * 1.e-3) size[i] = maxsize * 1.e-3;
+  }
+  locgridcell = cbrt(size[0] * size[1] * size[2] * 4.0 / (npoints + 1));
+  ncells = 1l;
+  for (i = 0; i < 3; i++) {
+    locgridsize[i] = (int) (size[i] / locgridcell) + 1;
+    if (locgridsize[i] > 1024) locgridsize[i] = 1024;
+    ncells *= locgridsize[i];
+  }
+
+  if (locgrid != NULL) {
+    delete [] locgrid;
+  }
+  locgrid = new point[ncells];
+  for (i = 0; i < ncells; i++) {
+    locgrid[i] = NULL;
+  }
+  totalworkmemory += ncells * sizeof(point);
+}
+
+// The cell index of a point along axis i.
+static int locgrid_index(REAL x, REAL xmin, REAL cell, int size)
+{
+  int i = (int) ((x - xmin) / cell);
+  if (i < 0) return 0;
+  if (i >= size) return size - 1;
+  return i;
+}
+
+void tetgenmesh::locgrid_insert(point pt)
+{
+  int ix = locgrid_index(pt[0], xmin, locgridcell, locgridsize[0]);
+  int iy = locgrid_index(pt[1], ymin, locgridcell, locgridsize[1]);
+  int iz = locgrid_index(pt[2], zmin, locgridcell, locgridsize[2]);
+
+  locgrid[((long) iz * locgridsize[1] + iy) * locgridsize[0] + ix] = pt;
+}
+
+//============================================================================//
+//                                                                            //
+// locgrid_seed()    Choose the starting tet to locate a point.               //
+//                                                                            //
+// Searches the cells around 'searchpt' ring by ring, at most 2 cells away,   //
+// for the nearest recorded vertex, and starts from its tet if it is nearer   //
+// than the origin of 'searchtet'.                                            //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::locgrid_seed(point searchpt, triface *searchtet)
+{
+  int c[3], lo[3], hi[3], r, i, ix, iy, iz;
+  point pt, nearpt = NULL;
+  REAL dist, neardist = 0.0;
+
+  c[0] = locgrid_index(searchpt[0], xmin, locgridcell, locgridsize[0]);
+  c[1] = locgrid_index(searchpt[1], ymin, locgridcell, locgridsize[1]);
+  c[2] = locgrid_index(searchpt[2], zmin, locgridcell, locgridsize[2]);
+
+  for (r = 0; (r <= 2) && (nearpt == NULL); r++) {
+    for (i = 0; i < 3; i++) {
+      lo[i] = (c[i] - r < 0) ? 0 : c[i] - r;
+      hi[i] = (c[i] + r >= locgridsize[i]) ? locgridsize[i] - 1 : c[i] + r;
+    }
+    for (iz = lo[2]; iz <= hi[2]; iz++) {
+      for (iy = lo[1]; iy <= hi[1]; iy++) {
+        for (ix = lo[0]; ix <= hi[0]; ix++) {
+          // Only the cells on the ring, the inner ones are empty.
+          if ((abs(ix - c[0]) < r) && (abs(iy - c[1]) < r) &&
+              (abs(iz - c[2]) < r)) continue;
+          pt = locgrid[((long) iz * locgridsize[1] + iy) * locgridsize[0] + ix];
+          if (pt == NULL) continue;
+          dist = distance2(pt, searchpt);
+          if ((nearpt == NULL) || (dist < neardist)) {
+            nearpt = pt;
+            neardist = dist;
+          }
+        }
+      }
+    }
+  }
+  if (nearpt == NULL) {
+    return;
+  }
+
+  triface neartet;
+  neartet.tet = (tetrahedron *) point2tet(nearpt);
+  if ((neartet.tet == NULL) || (neartet.tet[4] == NULL)) {
+    return; // The tet was deleted since.
+  }
+  if (searchtet->tet != NULL) {
+    searchtet->ver = 3;
+    if (distance2(org(*searchtet), searchpt) <= neardist) {
+      return;
+    }
+  }
+  searchtet->tet = neartet.tet;
+}
+
+void tetgenmesh::locgrid_free()
+{
+  long ncells = (long) locgridsize[0] * locgridsize[1] * locgridsize[2];
+
+  if (locgrid != NULL) {
+    delete [] locgrid;
+    locgrid = NULL;
+    totalworkmemory -= ncells * sizeof(point);
+  }
+}
+
 //============================================================================//
 //                                                                            //
 // locate()    Find a tetrahedron containing a given point.                   //
@@ -11239,7 +11661,9 @@ enum tetgenmesh::locateresult
   }
 
   // Walk through tetrahedra to locate the point.
+  locatecount++;
   do {
+    locatesteps++;
 
     toppo = oppo(*searchtet);
     
@@ -11254,7 +11678,7 @@ enum tetgenmesh::locateresult
     
     // We enter from one of serarchtet's faces, which face do we exit?
     // Randomly choose one of three faces (containig  toppo) of this tet.
-    s = rand() % 3; // s \in \{0,1,2\}
+    s = randomint() % 3; // s \in \{0,1,2\}
     for (i = 0; i < s; i++) enextself(*searchtet);
 
     oriorg = orient3d(dest(*searchtet), apex(*searchtet), toppo, searchpt);
@@ -11368,7 +11792,9 @@ enum tetgenmesh::locateresult
   }
 
   // Walk through tetrahedra to locate the point.
+  locatecount++;
   while (true) {
+    locatesteps++;
     toppo = oppo(*searchtet);
     
     // Check if the vertex is we seek.
@@ -11541,6 +11967,11 @@ int  tetgenmesh::insert_vertex_bw(point insertpt, triface *searchtet,
   bool enqflag;
   int t1ver;
   int i, j, k; //, s;
+  // The in-sphere tests of the four neighbors of a cavity tet, evaluated
+  //   together by insphere_batch().
+  point bpa[4], bpb[4], bpc[4], bpd[4];
+  REAL bdet[4];
+  int bidx[4], nbatch;
 
   if (b->verbose > 2) {
     printf("      Insert point %d\n", pointmark(insertpt));
@@ -11620,6 +12051,22 @@ int  tetgenmesh::insert_vertex_bw(point insertpt, triface *searchtet,
   for (i = 0; i < cave_oldtet_list->objects; i++) {
     ptptr = (tetrahedron **) fastlookup(cave_oldtet_list, i);
     cavetet.tet = *ptptr;
+    // The neighbors are distinct, testing one does not change the others.
+    nbatch = 0;
+    for (cavetet.ver = 0; cavetet.ver < 4; cavetet.ver++) {
+      neightet.tet = decode_tet_only(cavetet.tet[cavetet.ver]);
+      bidx[cavetet.ver] = -1;
+      if (!infected(neightet) && !marktested(neightet) &&
+          !ishulltet(neightet)) {
+        pts = (point *) neightet.tet;
+        bpa[nbatch] = pts[4];
+        bpb[nbatch] = pts[5];
+        bpc[nbatch] = pts[6];
+        bpd[nbatch] = pts[7];
+        bidx[cavetet.ver] = nbatch++;
+      }
+    }
+    insphere_batch(nbatch, bpa, bpb, bpc, bpd, insertpt, bdet);
     for (cavetet.ver = 0; cavetet.ver < 4; cavetet.ver++) {
       neightet.tet = decode_tet_only(cavetet.tet[cavetet.ver]);
       if (!infected(neightet)) {
@@ -11628,7 +12075,11 @@ int  tetgenmesh::insert_vertex_bw(point insertpt, triface *searchtet,
         if (!marktested(neightet)) {
           if (!ishulltet(neightet)) {
             pts = (point *) neightet.tet;
-            sign = insphere_s(pts[4], pts[5], pts[6], pts[7], insertpt);
+            // insphere_s() perturbs the zero determinants only.
+            sign = (bidx[cavetet.ver] >= 0) ? bdet[bidx[cavetet.ver]] : 0.0;
+            if (sign == 0.0) {
+              sign = insphere_s(pts[4], pts[5], pts[6], pts[7], insertpt);
+            }
             enqflag = (sign < 0.0);
           } else {
             pts = (point *) neightet.tet;
@@ -11747,7 +12198,7 @@ int  tetgenmesh::insert_vertex_bw(point insertpt, triface *searchtet,
 
     // Set a handle for speeding point location.
     // Randomly pick a new tet.
-    i = rand() % f_out;
+    i = randomint() % f_out;
     recenttet = * (triface *) fastlookup(cavebdrylist, i);    
     setpoint2tet(insertpt, (tetrahedron) (recenttet.tet));
 
@@ -11831,7 +12282,7 @@ int  tetgenmesh::insert_vertex_bw(point insertpt, triface *searchtet,
     // Set a handle for speeding point location.
     //recenttet = newtet;
     //setpoint2tet(insertpt, (tetrahedron) (newtet.tet));
-    i = rand() % f_out;
+    i = randomint() % f_out;
     recenttet = * (triface *) fastlookup(cavebdrylist, i);
     // This is still an oldtet.
     fsymself(recenttet);
@@ -11980,7 +12431,7 @@ void tetgenmesh::initialdelaunay(point pa, point pb, point pc, point pd)
 //============================================================================//
 
 
-void tetgenmesh::incrementaldelaunay(clock_t& tv)
+void tetgenmesh::incrementaldelaunay(REAL& tv)
 {
   triface searchtet;
   point *permutarray, swapvertex;
@@ -12008,9 +12459,9 @@ void tetgenmesh::incrementaldelaunay(clock_t& tv)
     if (b->verbose) {
       printf("  Permuting vertices.\n"); 
     }
-    srand(in->numberofpoints);
+    randomintseed = in->numberofpoints;
     for (i = 0; i < in->numberofpoints; i++) {
-      randindex = rand() % (i + 1); // randomnation(i + 1);
+      randindex = randomint() % (i + 1); // randomnation(i + 1);
       permutarray[i] = permutarray[randindex];
       permutarray[randindex] = (point) points->traverse();
     }
@@ -12024,7 +12475,7 @@ void tetgenmesh::incrementaldelaunay(clock_t& tv)
     }
   }
 
-  tv = clock(); // Remember the time for sorting points.
+  tv = walltime(); // Remember the time for sorting points.
 
   // Calculate the diagonal size of its bounding box.
   bboxsize = sqrt(norm2(xmax - xmin, ymax - ymin, zmax - zmin));
@@ -12117,8 +12568,16 @@ void tetgenmesh::incrementaldelaunay(clock_t& tv)
   ivf.bowywat = 1; // Use Bowyer-Watson algorithm
   ivf.lawson = 0;
 
+  long bak_locatecount = locatecount, bak_locatesteps = locatesteps;
+  if (b->locate_grid) { // -G
+    locgrid_init(in->numberofpoints);
+    for (i = 0; i < 4; i++) {
+      locgrid_insert(permutarray[i]);
+    }
+  }
 
   for (i = 4; i < in->numberofpoints; i++) {
+    checkprogress((REAL) i / (REAL) in->numberofpoints);
     if (pointtype(permutarray[i]) == UNUSEDVERTEX) {
       setpointtype(permutarray[i], VOLVERTEX);
     }
@@ -12129,6 +12588,13 @@ void tetgenmesh::incrementaldelaunay(clock_t& tv)
       // Randomly choose the starting tet for point location.
       searchtet.tet = NULL;
     }
+    if (b->locate_grid) { // -G
+      // Or from a nearby vertex.
+      if (searchtet.tet == NULL) {
+        randomsample(permutarray[i], &searchtet);
+      }
+      locgrid_seed(permutarray[i], &searchtet);
+    }
     ivf.iloc = (int) OUTSIDE;
     // Insert the vertex.
     if (!insert_vertex_bw(permutarray[i], &searchtet, &ivf)) {
@@ -12156,9 +12622,21 @@ void tetgenmesh::incrementaldelaunay(clock_t& tv)
         setpointtype(permutarray[i], NREGULARVERTEX);
         nonregularcount++;
       }
+    } else if (b->locate_grid) { // -G
+      locgrid_insert(permutarray[i]);
     }
   }
 
+  if (b->locate_grid) { // -G
+    locgrid_free();
+  }
+  if (b->verbose) {
+    long nlocate = locatecount - bak_locatecount;
+    printf("  Located %ld points, walked %.1f tets on average.\n", nlocate,
+           (nlocate > 0) ? (REAL) (locatesteps - bak_locatesteps) / nlocate
+                         : 0.0);
+  }
+
 
   
   delete [] permutarray;
@@ -15256,6 +15734,7 @@ void tetgenmesh::delaunizesegments()
 
   // Loop until 'subsegstack' is empty.
   while (subsegstack->objects > 0l) {
+    checkprogress(-1.0);
     // seglist is used as a stack.
     subsegstack->objects--;
     psseg = (face *) fastlookup(subsegstack, subsegstack->objects);
@@ -17999,7 +18478,7 @@ void tetgenmesh::constrainedfacets()
 //                                                                            //
 //============================================================================//
 
-void tetgenmesh::constraineddelaunay(clock_t& tv)
+void tetgenmesh::constraineddelaunay(REAL& tv)
 {
   face searchsh, *parysh;
   face searchseg, *paryseg;
@@ -18044,7 +18523,7 @@ void tetgenmesh::constraineddelaunay(clock_t& tv)
     printf("  Inserted %ld Steiner points.\n", st_segref_count); 
   }
 
-  tv = clock();
+  tv = walltime();
 
   if (b->verbose) {
     printf("  Constraining facets.\n");
@@ -19298,7 +19777,7 @@ int tetgenmesh::add_steinerpt_in_schoenhardtpoly(triface *abtets, int n,
 
   if (splitsliverflag) {
     // randomly pick a tet.
-    int idx = rand() % n;
+    int idx = randomint() % n;
 
     // Calulcate the barycenter of this tet.
     point pa = org(abtets[idx]);
@@ -20361,6 +20840,7 @@ int tetgenmesh::recoversegments(arraypool *misseglist, int fullsearch,
 
   // Loop until 'subsegstack' is empty.
   while (subsegstack->objects > 0l) {
+    checkprogress(-1.0);
     // seglist is used as a stack.
     subsegstack->objects--;
     paryseg = (face *) fastlookup(subsegstack, subsegstack->objects);
@@ -20786,6 +21266,7 @@ int tetgenmesh::recoversubfaces(arraypool *misshlist, int steinerflag)
 
   // Loop until 'subfacstack' is empty.
   while (subfacstack->objects > 0l) {
+    checkprogress(-1.0);
 
     subfacstack->objects--;
     parysh = (face *) fastlookup(subfacstack, subfacstack->objects);
@@ -23043,7 +23524,7 @@ int tetgenmesh::suppresssteinerpoints()
 //                                                                            //
 //============================================================================//
 
-void tetgenmesh::recoverboundary(clock_t& tv)
+void tetgenmesh::recoverboundary(REAL& tv)
 {
   arraypool *misseglist, *misshlist;
   arraypool *bdrysteinerptlist;
@@ -23307,7 +23788,7 @@ void tetgenmesh::recoverboundary(clock_t& tv)
   }
 
 
-  tv = clock();
+  tv = walltime();
 
   if (b->verbose) {
     printf("  Recovering facets.\n");
@@ -25219,6 +25700,219 @@ int tetgenmesh::scout_point(point searchpt, triface *searchtet, int randflag)
   return (int) loc;
 }
 
+//============================================================================//
+//                                                                            //
+// sizegrid_build()    Index the tets of a background mesh by a uniform grid. //
+//                                                                            //
+// scout_point() walks to a point from a random or a nearby tet, which is     //
+// slow in a large background mesh, fails where the walk leaves a non-convex  //
+// domain, and changes the random seed, so it can not run on several threads. //
+// Instead, each cell of a uniform grid over the bounding box lists the tets  //
+// whose bounding box meets it.  sizegrid_locate() only tests the tets in the //
+// cell of the point and does not change anything.                            //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::sizegrid_build()
+{
+  REAL size[3] = {xmax - xmin, ymax - ymin, zmax - zmin};
+  REAL bmin[3] = {xmin, ymin, zmin};
+  REAL maxsize = size[0];
+  tetrahedron *tptr;
+  point *pts;
+  long ncells, cell, k;
+  int lo[3], hi[3], pass, i, j, ix, iy, iz;
+
+  sizegrid_free();
+
+  for (i = 1; i < 3; i++) {
+    if (size[i] > maxsize) maxsize = size[i];
+  }
+  for (i = 0; i < 3; i++) {
+    if (size[i] < maxsize * 1.e-3) size[i] = maxsize * 1.e-3;
+  }
+  // Cubic cells of volume about 4 tets.  Smaller ones list each tet in many
+  //   more cells, larger ones have more tets to test.
+  sizegridcell = cbrt(size[0] * size[1] * size[2] * 4.0 /
+                      (tetrahedrons->items - hullsize + 1));
+  ncells = 1l;
+  for (i = 0; i < 3; i++) {
+    sizegridsize[i] = (int) (size[i] / sizegridcell) + 1;
+    if (sizegridsize[i] > 1024) sizegridsize[i] = 1024;
+    ncells *= sizegridsize[i];
+  }
+  sizegridstart = new long[ncells + 1];
+  for (k = 0; k <= ncells; k++) {
+    sizegridstart[k] = 0l;
+  }
+
+  // Count the tets of each cell, then list them.  The second pass uses
+  //   sizegridstart[i] as the end of the list of cell i so far, which
+  //   leaves it at the start of cell i + 1.
+  for (pass = 0; pass < 2; pass++) {
+    tetrahedrons->traversalinit();
+    tptr = tetrahedrontraverse();
+    while (tptr != NULL) {
+      pts = (point *) &(tptr[4]);
+      for (i = 0; i < 3; i++) {
+        REAL tmin = pts[0][i], tmax = pts[0][i];
+        for (j = 1; j < 4; j++) {
+          if (pts[j][i] < tmin) tmin = pts[j][i];
+          if (pts[j][i] > tmax) tmax = pts[j][i];
+        }
+        lo[i] = locgrid_index(tmin, bmin[i], sizegridcell, sizegridsize[i]);
+        hi[i] = locgrid_index(tmax, bmin[i], sizegridcell, sizegridsize[i]);
+      }
+      for (iz = lo[2]; iz <= hi[2]; iz++) {
+        for (iy = lo[1]; iy <= hi[1]; iy++) {
+          for (ix = lo[0]; ix <= hi[0]; ix++) {
+            cell = ((long) iz * sizegridsize[1] + iy) * sizegridsize[0] + ix;
+            if (pass == 0) {
+              sizegridstart[cell + 1]++;
+            } else {
+              sizegridtets[sizegridstart[cell]++] = tptr;
+            }
+          }
+        }
+      }
+      tptr = tetrahedrontraverse();
+    }
+    if (pass == 0) {
+      for (k = 0; k < ncells; k++) {
+        sizegridstart[k + 1] += sizegridstart[k];
+      }
+      sizegridtets = new tetrahedron*[sizegridstart[ncells]];
+    } else {
+      for (k = ncells; k > 0; k--) {
+        sizegridstart[k] = sizegridstart[k - 1];
+      }
+      sizegridstart[0] = 0l;
+    }
+  }
+
+  totalworkmemory += (ncells + 1) * sizeof(long) +
+                     sizegridstart[ncells] * sizeof(tetrahedron *);
+
+  if (b->verbose > 1) {
+    printf("    Size grid %d x %d x %d, %ld tets listed.\n", sizegridsize[0],
+           sizegridsize[1], sizegridsize[2], sizegridstart[ncells]);
+  }
+}
+
+//============================================================================//
+//                                                                            //
+// sizegrid_locate()    Find the tet of a background mesh containing a point. //
+//                                                                            //
+// Returns the location of 'searchpt' like scout_point(), with 'searchtet' at //
+// the tet, face, edge or vertex containing it, or OUTSIDE.  A point outside  //
+// the mesh by at most 'b->epsilon' in the barycentric coordinates of a tet   //
+// (e.g. a Steiner point on a facet off by a roundoff) is put inside it.      //
+// Safe to call from several threads.                                         //
+//                                                                            //
+//============================================================================//
+
+int tetgenmesh::sizegrid_locate(point searchpt, triface *searchtet)
+{
+  tetrahedron *tptr, *neartet = NULL;
+  point *pts, pt[4];
+  REAL vol, ori, minwei, nearwei = 0.0;
+  long cell, k;
+  int keep, zeros, i, j;
+
+  if (sizegridtets == NULL) {
+    return (int) OUTSIDE;
+  }
+  cell = ((long) locgrid_index(searchpt[2], zmin, sizegridcell,
+                               sizegridsize[2]) * sizegridsize[1] +
+          locgrid_index(searchpt[1], ymin, sizegridcell, sizegridsize[1])) *
+         sizegridsize[0] +
+         locgrid_index(searchpt[0], xmin, sizegridcell, sizegridsize[0]);
+
+  for (k = sizegridstart[cell]; k < sizegridstart[cell + 1]; k++) {
+    tptr = sizegridtets[k];
+    pts = (point *) &(tptr[4]);
+    vol = orient3d(pts[0], pts[1], pts[2], pts[3]);
+    if (vol == 0.0) continue;
+    // With a vertex replaced by the point, the orientation has the sign of
+    //   the tet, or is zero if the point is on the plane of the other three.
+    //   The vertices where it is not zero are the ones of the face, edge or
+    //   vertex containing the point.
+    keep = zeros = 0;
+    for (i = 0; i < 4; i++) {
+      pt[0] = pts[0]; pt[1] = pts[1]; pt[2] = pts[2]; pt[3] = pts[3];
+      pt[i] = searchpt;
+      ori = orient3d(pt[0], pt[1], pt[2], pt[3]);
+      if (ori == 0.0) {
+        zeros++;
+      } else if ((ori > 0.0) == (vol > 0.0)) {
+        keep |= (1 << i);
+      } else {
+        break;
+      }
+    }
+    if (i < 4) continue;
+
+    searchtet->tet = tptr;
+    if (zeros == 0) {
+      searchtet->ver = 11;
+      return (int) INTETRAHEDRON;
+    }
+    for (searchtet->ver = 0; searchtet->ver < 12; searchtet->ver++) {
+      pt[0] = org(*searchtet);
+      pt[1] = dest(*searchtet);
+      pt[2] = apex(*searchtet);
+      for (j = 0; j < 4 - zeros; j++) {
+        for (i = 0; pts[i] != pt[j]; i++);
+        if (!(keep & (1 << i))) break;
+      }
+      if (j == 4 - zeros) break;
+    }
+    if (zeros == 1) return (int) ONFACE;
+    if (zeros == 2) return (int) ONEDGE;
+    return (int) ONVERTEX;
+  }
+
+  // Not inside a tet, take the nearest one within the tolerance.
+  for (k = sizegridstart[cell]; k < sizegridstart[cell + 1]; k++) {
+    tptr = sizegridtets[k];
+    pts = (point *) &(tptr[4]);
+    vol = orient3d(pts[0], pts[1], pts[2], pts[3]);
+    if (vol == 0.0) continue;
+    minwei = 1.0;
+    for (i = 0; i < 4; i++) {
+      pt[0] = pts[0]; pt[1] = pts[1]; pt[2] = pts[2]; pt[3] = pts[3];
+      pt[i] = searchpt;
+      ori = orient3d(pt[0], pt[1], pt[2], pt[3]) / vol;
+      if (ori < minwei) minwei = ori;
+    }
+    if ((neartet == NULL) || (minwei > nearwei)) {
+      neartet = tptr;
+      nearwei = minwei;
+    }
+  }
+  if ((neartet != NULL) && (nearwei > -b->epsilon)) {
+    searchtet->tet = neartet;
+    searchtet->ver = 11;
+    return (int) INTETRAHEDRON;
+  }
+
+  return (int) OUTSIDE;
+}
+
+void tetgenmesh::sizegrid_free()
+{
+  long ncells = (long) sizegridsize[0] * sizegridsize[1] * sizegridsize[2];
+
+  if (sizegridtets != NULL) {
+    totalworkmemory -= (ncells + 1) * sizeof(long) +
+                       sizegridstart[ncells] * sizeof(tetrahedron *);
+    delete [] sizegridtets;
+    delete [] sizegridstart;
+    sizegridtets = NULL;
+    sizegridstart = NULL;
+  }
+}
+
 //============================================================================//
 //                                                                            //
 // getpointmeshsize()    Interpolate the mesh size at given point.            //
@@ -25287,42 +25981,141 @@ REAL tetgenmesh::getpointmeshsize(point searchpt, triface *searchtet, int iloc)
   return size;
 }
 
+//============================================================================//
+//                                                                            //
+// getfieldmeshsize()    Get the mesh size at a point from the size field.    //
+//                                                                            //
+// The size field is the callback 'in->meshsizefunc' or the regular grid of   //
+// sizes 'in->meshsizegrid' (see tetgenio).  Returns 0 if it has no size at   //
+// the point.                                                                 //
+//                                                                            //
+//============================================================================//
+
+REAL tetgenmesh::getfieldmeshsize(point searchpt)
+{
+  int *dims = in->meshsizegriddims;
+  REAL t[3], wei, value, size = 0.0;
+  int c[3], d[3], i, k;
+
+  if (in->meshsizefunc != NULL) {
+    size = in->meshsizefunc(in->meshsizehandle, searchpt[0], searchpt[1],
+                            searchpt[2]);
+  } else if ((in->meshsizegrid != NULL) && (dims[0] > 0) && (dims[1] > 0) &&
+             (dims[2] > 0)) {
+    // The cell containing the point (clamped to the grid) and the position
+    //   in it.
+    for (i = 0; i < 3; i++) {
+      t[i] = (searchpt[i] - in->meshsizegridorigin[i]) /
+             in->meshsizegridspacing[i];
+      if ((dims[i] < 2) || !(t[i] > 0.0)) {
+        c[i] = 0;
+        t[i] = 0.0;
+      } else if (t[i] >= dims[i] - 1) {
+        c[i] = dims[i] - 2;
+        t[i] = 1.0;
+      } else {
+        c[i] = (int) t[i];
+        t[i] -= c[i];
+      }
+    }
+    // Trilinear interpolation of the corners which have a weight.
+    for (k = 0; k < 8; k++) {
+      wei = 1.0;
+      for (i = 0; i < 3; i++) {
+        d[i] = (k >> i) & 1;
+        wei *= d[i] ? t[i] : 1.0 - t[i];
+      }
+      if (wei == 0.0) continue;
+      value = in->meshsizegrid[((long) (c[2] + d[2]) * dims[1] + c[1] + d[1])
+                               * dims[0] + c[0] + d[0]];
+      if (!(value > 0.0)) {
+        return 0.0;
+      }
+      size += wei * value;
+    }
+  }
+
+  return (size > 0.0) ? size * b->metric_scale : 0.0;
+}
+
 //============================================================================//
 //                                                                            //
 // interpolatemeshsize()    Interpolate the mesh size from a background mesh  //
 //                          (source) to the current mesh (destination).       //
 //                                                                            //
+// Without a background mesh, the sizes are taken from the size field.  The   //
+// points are shared among the threads of -j, except if the size field is a   //
+// callback, which may not be reentrant.                                      //
+//                                                                            //
 //============================================================================//
 
 void tetgenmesh::interpolatemeshsize()
 {
-  triface searchtet;
-  point ploop;
+  point *ptarray, ploop;
   REAL minval = 0.0, maxval = 0.0;
-  int iloc;
+  char *located;
+  long npoints, i;
+  int nthreads = (b->num_threads > 0) ? b->num_threads : 1;
   int count;
 
   if (!b->quiet) {
     printf("Interpolating mesh size ...\n");
   }
 
-  long bak_nonregularcount = nonregularcount;
-  nonregularcount = 0l; // Count the number of (slow) global searches.
-  long baksmaples = bgm->samples;
-  bgm->samples = 3l;
-  count = 0; // Count the number of interpolated points.
-
-  // Interpolate sizes for all points in the current mesh.
+  npoints = 0l;
+  ptarray = new point[points->items];
   points->traversalinit();
   ploop = pointtraverse();
   while (ploop != NULL) {
-    // Search a tet in bgm which containing this point.
-    searchtet.tet = NULL;
-    iloc = bgm->scout_point(ploop, &searchtet, 1); // randflag = 1
-    if (iloc != (int) OUTSIDE) {
-      // Interpolate the mesh size.
-      ploop[pointmtrindex] = bgm->getpointmeshsize(ploop, &searchtet, iloc);
-      setpoint2bgmtet(ploop, bgm->encode(searchtet));
+    ptarray[npoints++] = ploop;
+    ploop = pointtraverse();
+  }
+  located = new char[npoints];
+
+  if ((bgm == NULL) && (in->meshsizefunc != NULL)) {
+    nthreads = 1; // The user-defined function may not be reentrant.
+  }
+  if (nthreads > npoints / 1024 + 1) {
+    nthreads = (int) (npoints / 1024 + 1);
+  }
+
+  // The threads only read the background mesh.  They initialize the
+  //   predicates with its bounding box, as the calling thread did last.
+  runthreads(bgm != NULL ? bgm : this, nthreads, [&](int t) {
+    triface searchtet;
+    REAL size;
+    int iloc;
+    for (long k = npoints * t / nthreads; k < npoints * (t + 1) / nthreads;
+         k++) {
+      located[k] = 0;
+      if (bgm != NULL) {
+        // Search a tet in bgm which containing this point.
+        iloc = bgm->sizegrid_locate(ptarray[k], &searchtet);
+        if (iloc != (int) OUTSIDE) {
+          // Interpolate the mesh size.
+          ptarray[k][pointmtrindex] =
+            bgm->getpointmeshsize(ptarray[k], &searchtet, iloc);
+          setpoint2bgmtet(ptarray[k], bgm->encode(searchtet));
+          located[k] = 1;
+        }
+      } else {
+        size = getfieldmeshsize(ptarray[k]);
+        if (size > 0.0) {
+          ptarray[k][pointmtrindex] = size;
+          located[k] = 1;
+        }
+      }
+    }
+  });
+  if (bgm != NULL) {
+    workercputime += bgm->workercputime;
+    bgm->workercputime = 0.0;
+  }
+
+  count = 0; // Count the number of interpolated points.
+  for (i = 0; i < npoints; i++) {
+    ploop = ptarray[i];
+    if (located[i]) {
       if (count == 0) {
         // This is the first interpolated point.
         minval = maxval = ploop[pointmtrindex];
@@ -25335,25 +26128,21 @@ void tetgenmesh::interpolatemeshsize()
         }
       }
       count++;
-    } else {
+    } else if (bgm != NULL) {
       if (!b->quiet) {
         printf("Warnning:  Failed to locate point %d in source mesh.\n",
                pointmark(ploop));
       }
     }
-    ploop = pointtraverse();
   }
 
   if (b->verbose) {
     printf("  Interoplated %d points.\n", count);
-    if (nonregularcount > 0l) {
-      printf("  Performed %ld brute-force searches.\n", nonregularcount);
-    }
     printf("  Size rangle [%.17g, %.17g].\n", minval, maxval);
   }
 
-  bgm->samples = baksmaples;
-  nonregularcount = bak_nonregularcount;
+  delete [] located;
+  delete [] ptarray;
 }
 
 //============================================================================//
@@ -25391,9 +26180,9 @@ void tetgenmesh::insertconstrainedpoints(point *insertarray, int arylen,
     }
     point swappoint;
     int randindex;
-    srand(arylen);
+    randomintseed = arylen;
     for (i = 0; i < arylen; i++) {
-      randindex = rand() % (i + 1); 
+      randindex = randomint() % (i + 1); 
       swappoint = insertarray[i];
       insertarray[i] = insertarray[randindex];
       insertarray[randindex] = swappoint;
@@ -25707,9 +26496,9 @@ void tetgenmesh::collectremovepoints(arraypool *remptlist)
       // Sort the list of points randomly.
       point *parypt_i, swappt;
       int randindex, i;
-      srand(intptlist->objects);
+      randomintseed = intptlist->objects;
       for (i = 0; i < intptlist->objects; i++) {
-        randindex = rand() % (i + 1); // randomnation(i + 1);
+        randindex = randomint() % (i + 1); // randomnation(i + 1);
         parypt_i = (point *) fastlookup(intptlist, i); 
         parypt = (point *) fastlookup(intptlist, randindex);
         // Swap this two points.
@@ -27128,6 +27917,7 @@ void tetgenmesh::repairencsegs(REAL *param, int qflag, int chkencflag)
 
   while (ref_segment &&
          ((badsubsegs->items > 0) || (split_segments_pool->items > 0))) {
+    checkprogress(-1.0);
   
     if (badsubsegs->items > 0) {
       badsubsegs->traversalinit();
@@ -27630,7 +28420,7 @@ tetgenmesh::locate_on_surface(point searchpt, face* searchsh)
         enextself(searchtet);
       } else if (ori2 < 0) {
         // Randomly choose one.
-        if (rand() % 2) { // flipping a coin.
+        if (randomint() % 2) { // flipping a coin.
           //E.ver = _enext_tbl[E.ver];
           enextself(searchtet);
         } else {
@@ -27968,6 +28758,7 @@ void tetgenmesh::repairencfacs(REAL *param, int qflag, int chkencflag)
 
   while (ref_subface &&
          ((badsubfacs->items > 0) || (split_subfaces_pool->items > 0))) {
+    checkprogress(-1.0);
 
     if (badsubfacs->items > 0) {
       badsubfacs->traversalinit();
@@ -29035,6 +29826,7 @@ void tetgenmesh::repairbadtets(REAL queratio, int chkencflag)
   int i;
 
   while ((badtetrahedrons->items > 0) || (check_tets_list->objects > 0)) {
+    checkprogress(-1.0);
 
     if (badtetrahedrons->items > 0) {
       badtetrahedrons->traversalinit();
@@ -29055,7 +29847,7 @@ void tetgenmesh::repairbadtets(REAL queratio, int chkencflag)
 
 
     // Randomly select a tet to split.
-    i = rand() % check_tets_list->objects;
+    i = randomint() % check_tets_list->objects;
     quetet = (triface *) fastlookup(check_tets_list, i);
     checktet = *quetet;
     
@@ -29742,6 +30534,7 @@ long tetgenmesh::lawsonflip3d(flipconstraints *fc)
     flipcount = 0l;
 
     while (flipstack != (badface *) NULL) {
+      checkprogress(-1.0);
       // Pop a face from the stack.
       popface = flipstack;
       fliptets[0] = popface->tt;
@@ -30449,6 +31242,45 @@ int tetgenmesh::get_laplacian_center(point mesh_vert, REAL target[3])
   return 1;
 }
 
+//============================================================================//
+//                                                                            //
+// star_orient_valid()    Test if a vertex star stays valid at a new position.//
+//                                                                            //
+// 'tetlist' is the star of a vertex, each tet faces its vertex. Returns true //
+// if 'newpos' lies on the negative side of all faces other than hull faces.  //
+// The orientations are evaluated in batches by orient3d_batch().            //
+//                                                                            //
+//============================================================================//
+
+bool tetgenmesh::star_orient_valid(arraypool* tetlist, REAL* newpos)
+{
+  const int batchsize = 32;
+  point bpa[batchsize], bpb[batchsize], bpc[batchsize];
+  REAL bdet[batchsize];
+  triface* cavetet;
+  int i, k, n;
+
+  i = 0;
+  while (i < tetlist->objects) {
+    n = 0;
+    for (; (i < tetlist->objects) && (n < batchsize); i++) {
+      cavetet = (triface *) fastlookup(tetlist, i);
+      if (ishulltet(*cavetet)) continue; // Skip a hull face.
+      bpa[n] =  org(*cavetet);
+      bpb[n] = dest(*cavetet);
+      bpc[n] = apex(*cavetet);
+      n++;
+    }
+    orient3d_batch(n, bpa, bpb, bpc, newpos, bdet);
+    for (k = 0; k < n; k++) {
+      if (bdet[k] >= 0) {
+        return false; // This tet becomes invalid.
+      }
+    }
+  }
+  return true;
+}
+
 //============================================================================//
 //                                                                            //
 // move_vertex()    Try to move a given vertex towards the target position.   //
@@ -30470,10 +31302,7 @@ bool tetgenmesh::move_vertex(point mesh_vert, REAL target[3])
     }
     return 0;
   }
-  triface* cavetet;
-  point pa, pb, pc;
-  REAL ori;
-  int i, j;
+  int j;
 
   REAL dir[3], newpos[3];
   REAL alpha = b->smooth_alpha; // 0.3;
@@ -30491,18 +31320,8 @@ bool tetgenmesh::move_vertex(point mesh_vert, REAL target[3])
   int iter = 0;
 
   while (iter < 3) {
-    for (i = 0; i < caveoldtetlist->objects; i++) {
-      cavetet = (triface *) fastlookup(caveoldtetlist, i);
-      if (ishulltet(*cavetet)) continue; // Skip a hull face.
-
-      pa =  org(*cavetet);
-      pb = dest(*cavetet);
-      pc = apex(*cavetet);
-      ori = orient3d(pa, pb, pc, newpos);
-      if (ori >= 0) {
-        moveflag = false;
-        break; // This tet becomes invalid.
-      }
+    if (!star_orient_valid(caveoldtetlist, newpos)) {
+      moveflag = false;
     }
     if (moveflag) {
       break;
@@ -30519,46 +31338,354 @@ bool tetgenmesh::move_vertex(point mesh_vert, REAL target[3])
     for (j = 0; j < 3; j++) {
       mesh_vert[j] = newpos[j];
     }
+    flip_vertex_star(mesh_vert);
+  } // if (moveflag)
+
+  caveoldtetlist->restart();
+  return moveflag;
+}
+
+//============================================================================//
+//                                                                            //
+// flip_vertex_star()    Restore the Delaunay property at a moved vertex.     //
+//                                                                            //
+// The star of "mesh_vert" is taken from 'caveoldtetlist' if it is not empty, //
+// and is collected otherwise. Its faces and link faces are queued and        //
+// flipped by lawsonflip3d().                                                 //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::flip_vertex_star(point mesh_vert)
+{
+  triface *cavetet;
+  triface checkface, neightet;
+  int i, j;
+
+  if (caveoldtetlist->objects == 0l) {
+    getvertexstar(1, mesh_vert, caveoldtetlist, NULL, NULL);
+  }
 
-    triface checkface, neightet;
-    //int j;
+  // Push all faces of this vertex star and link into queue.
+  for (i = 0; i < caveoldtetlist->objects; i++) {
+    cavetet = (triface *) fastlookup(caveoldtetlist, i);
+    if (ishulltet(*cavetet)) continue; // Skip a hull face.
+    flippush(flipstack, cavetet);
+    for (j = 0; j < 3; j++) {
+      esym(*cavetet, checkface);
+      fsym(checkface, neightet);
+      if (!facemarked(neightet)) {
+        flippush(flipstack, &checkface);
+      }
+      enextself(*cavetet);
+    }
+  }
 
-    // Push all faces of this vertex star and link into queue.
+  if (badtetrahedrons != NULL) {
+    // queue all cavity tets for quality check.
     for (i = 0; i < caveoldtetlist->objects; i++) {
       cavetet = (triface *) fastlookup(caveoldtetlist, i);
       if (ishulltet(*cavetet)) continue; // Skip a hull face.
-      flippush(flipstack, cavetet);
-      for (j = 0; j < 3; j++) {
-        esym(*cavetet, checkface);
-        fsym(checkface, neightet);
-        if (!facemarked(neightet)) {
-          flippush(flipstack, &checkface);
-        }
-        enextself(*cavetet);
+      enqueuetetrahedron(cavetet);
+    }
+  }
+
+  flipconstraints fc;
+  fc.enqflag = 2; // queue all exterior faces of a flip.
+  if (badtetrahedrons != NULL) {
+    fc.chkencflag = 4; // queue new tets for quality check.
+  }
+  lawsonflip3d(&fc);
+
+  caveoldtetlist->restart();
+}
+
+//============================================================================//
+//                                                                            //
+// getvertexstar_unmarked()    Get the star of a vertex without marking it.   //
+//                                                                            //
+// Return the same lists as getvertexstar(1, searchpt, tetlist, vertlist,     //
+// NULL), in the same order. No tet or vertex is infected, the collected ones //
+// are remembered in a hash table of each thread instead, so the stars of     //
+// different vertices can be collected on different threads at the same time.//
+//                                                                            //
+//============================================================================//
+
+int tetgenmesh::getvertexstar_unmarked(point searchpt, arraypool* tetlist,
+                                       arraypool* vertlist)
+{
+  // The tets and vertices collected so far (their addresses differ). A slot
+  //   is used if it has the stamp of the current call, so a new stamp clears
+  //   the table. It is kept at most half full and grows with the largest
+  //   star seen on the thread.
+  static thread_local std::vector<uintptr_t> table;
+  static thread_local std::vector<unsigned int> stamps;
+  static thread_local unsigned int stamp = 0;
+  triface searchtet, neightet, *parytet;
+  point pt, *parypt;
+  long count = 0, k;
+  int t1ver;
+  int i, j;
+
+  auto place = [&](uintptr_t key) -> bool {
+    size_t mask = table.size() - 1;
+    size_t h = (size_t) ((key >> 4) * 2654435761u) & mask;
+    for (; stamps[h] == stamp; h = (h + 1) & mask) {
+      if (table[h] == key) return false;
+    }
+    table[h] = key;
+    stamps[h] = stamp;
+    count++;
+    return true;
+  };
+  // Add a key into the table. Return false if it is already in there.
+  auto collect = [&](uintptr_t key) -> bool {
+    if (2 * (count + 1) > (long) table.size()) {
+      // Double the table and add the collected tets and vertices again.
+      table.assign(table.empty() ? 256 : 2 * table.size(), 0);
+      stamps.assign(table.size(), 0);
+      stamp = 1;
+      count = 0;
+      for (k = 0; k < tetlist->objects; k++) {
+        place((uintptr_t) ((triface *) fastlookup(tetlist, k))->tet);
+      }
+      for (k = 0; k < vertlist->objects; k++) {
+        place((uintptr_t) * (point *) fastlookup(vertlist, k));
       }
     }
+    return place(key);
+  };
 
-    if (badtetrahedrons != NULL) {
-      // queue all cavity tets for quality check.
-      for (i = 0; i < caveoldtetlist->objects; i++) {
-        cavetet = (triface *) fastlookup(caveoldtetlist, i);
-        if (ishulltet(*cavetet)) continue; // Skip a hull face.
-        enqueuetetrahedron(cavetet);
+  if (++stamp == 0) {
+    // The stamps wrapped around.
+    std::fill(stamps.begin(), stamps.end(), 0);
+    stamp = 1;
+  }
+  tetlist->restart();
+  vertlist->restart();
+
+  point2tetorg(searchpt, searchtet);
+
+  // Go to the opposite face (the link face) of the vertex.
+  enextesymself(searchtet);
+  collect((uintptr_t) searchtet.tet);
+  tetlist->newindex((void **) &parytet);
+  *parytet = searchtet;
+  // Collect three (link) vertices.
+  j = (searchtet.ver & 3); // The current vertex index.
+  for (i = 1; i < 4; i++) {
+    pt = (point) searchtet.tet[4 + ((j + i) % 4)];
+    collect((uintptr_t) pt);
+    vertlist->newindex((void **) &parypt);
+    *parypt = pt;
+  }
+
+  // Continue to collect all tets in the star.
+  for (i = 0; i < tetlist->objects; i++) {
+    searchtet = * (triface *) fastlookup(tetlist, i);
+    // The first tet has all three other faces unvisited.
+    for (j = (i == 0 ? -1 : 0); j < 2; j++) {
+      if (j >= 0) enextself(searchtet);
+      esym(searchtet, neightet);
+      fsymself(neightet);
+      if (collect((uintptr_t) neightet.tet)) {
+        esymself(neightet); // Go to the face opposite to 'searchpt'.
+        tetlist->newindex((void **) &parytet);
+        *parytet = neightet;
+        pt = apex(neightet);
+        if (collect((uintptr_t) pt)) {
+          vertlist->newindex((void **) &parypt);
+          *parypt = pt;
+        }
       }
+    } // j
+  } // i
+
+  return (int) tetlist->objects;
+}
+
+//============================================================================//
+//                                                                            //
+// move_vertex_unflipped()    Move a vertex without restoring Delaunayness.   //
+//                                                                            //
+// The same test as move_vertex(), but the star is collected in 'tetlist' and //
+// no face is flipped afterwards. It can run on different threads for         //
+// vertices not sharing an edge, since their stars do not share a tet.        //
+//                                                                            //
+//============================================================================//
+
+bool tetgenmesh::move_vertex_unflipped(point mesh_vert, REAL target[3],
+                                       arraypool* tetlist)
+{
+  if (pointtype(mesh_vert) == UNUSEDVERTEX) {
+    return false;
+  }
+  // Do not move if the target is already very close the vertex.
+  if (distance(mesh_vert, target) < minedgelength) {
+    return false;
+  }
+  REAL dir[3], newpos[3];
+  REAL alpha = b->smooth_alpha; // 0.3;
+  int j;
+
+  for (j = 0; j < 3; j++) {
+    dir[j] = target[j] - mesh_vert[j];
+    newpos[j] = mesh_vert[j] + alpha * dir[j];
+  }
+
+  getvertexstar(1, mesh_vert, tetlist, NULL, NULL);
+
+  bool moveflag = true;
+  int iter = 0;
+
+  while (iter < 3) {
+    if (!star_orient_valid(tetlist, newpos)) {
+      moveflag = false;
+    }
+    if (moveflag) {
+      break;
+    } else {
+      alpha = (alpha / 2.);
+      for (j = 0; j < 3; j++) {
+        newpos[j] = mesh_vert[j] + alpha * dir[j];
+      }
+      iter++;
     }
+  } // while (iter < 3)
 
-    flipconstraints fc;
-    fc.enqflag = 2; // queue all exterior faces of a flip.
-    if (badtetrahedrons != NULL) {
-      fc.chkencflag = 4; // queue new tets for quality check.
+  if (moveflag) {
+    for (j = 0; j < 3; j++) {
+      mesh_vert[j] = newpos[j];
     }
-    lawsonflip3d(&fc);
+  }
+  tetlist->restart();
+  return moveflag;
+}
+
+//============================================================================//
+//                                                                            //
+// smooth_vertices_colored()    Smooth volume vertices on multiple threads.   //
+//                                                                            //
+// Used by smooth_vertices() with '-j#' for the Steiner points in the volume, //
+// also with one thread, so that the mesh does not depend on #.               //
+// The Laplacian centers and the neighbors of all vertices are computed on #  //
+// threads. The vertices are then greedily colored, in list order, such that  //
+// no two vertices of the same color share an edge. The vertices of a color   //
+// are moved on # threads at the same time, the colors one after another. No  //
+// face is flipped while moving, so the coloring stays valid. At last the     //
+// stars of all moved vertices are flipped in list order. The result is the  //
+// same for any number of threads.                                            //
+//                                                                            //
+// The point markers temporarily hold -2 - i for the i-th vertex in the list, //
+// to find the index of a neighbor.                                           //
+//                                                                            //
+//============================================================================//
 
+void tetgenmesh::smooth_vertices_colored(point *smpt_list, REAL *target_list,
+                                         int npt, int &movedcount,
+                                         int &unmovedcount)
+{
+  int nthreads = b->num_threads;
+  int i, k, c;
 
-  } // if (moveflag)
+  if (npt == 0) return;
 
-  caveoldtetlist->restart();
-  return moveflag;
+  int *marks = new int[npt];
+  for (i = 0; i < npt; i++) {
+    marks[i] = pointmark(smpt_list[i]);
+    setpointmark(smpt_list[i], -2 - i);
+  }
+
+  // Get the Laplacian centers and the neighbors of all vertices.
+  std::vector<std::vector<int> > nbrs(npt);
+  int tthreads = nthreads < (npt / 256 + 1) ? nthreads : (npt / 256 + 1);
+  runthreads(this, tthreads, [&](int t) {
+    arraypool tetlist(sizeof(triface), 8), vertlist(sizeof(point), 8);
+    for (int m = npt * t / tthreads; m < npt * (t + 1) / tthreads; m++) {
+      if (pointtype(smpt_list[m]) == UNUSEDVERTEX) continue;
+      getvertexstar_unmarked(smpt_list[m], &tetlist, &vertlist);
+      REAL *target = &(target_list[m * 3]);
+      target[0] = target[1] = target[2] = 0.;
+      for (long l = 0; l < vertlist.objects; l++) {
+        point lpt = * (point *) fastlookup(&vertlist, l);
+        target[0] += lpt[0];
+        target[1] += lpt[1];
+        target[2] += lpt[2];
+        if (pointmark(lpt) <= -2) {
+          nbrs[m].push_back(-2 - pointmark(lpt));
+        }
+      }
+      target[0] /= (double) vertlist.objects;
+      target[1] /= (double) vertlist.objects;
+      target[2] /= (double) vertlist.objects;
+    }
+  });
+
+  for (i = 0; i < npt; i++) {
+    setpointmark(smpt_list[i], marks[i]);
+  }
+  delete [] marks;
+
+  // Greedily color the vertices.
+  std::vector<int> colors(npt, -1);
+  std::vector<char> usedcolors;
+  int ncolors = 0;
+  for (i = 0; i < npt; i++) {
+    usedcolors.assign(ncolors + 1, 0);
+    for (k = 0; k < (int) nbrs[i].size(); k++) {
+      if (colors[nbrs[i][k]] >= 0) {
+        usedcolors[colors[nbrs[i][k]]] = 1;
+      }
+    }
+    for (c = 0; usedcolors[c]; c++);
+    colors[i] = c;
+    if (c == ncolors) ncolors++;
+  }
+
+  // Sort the vertices by color, each color in list order.
+  std::vector<int> colorstart(ncolors + 1, 0), colorlist(npt);
+  for (i = 0; i < npt; i++) {
+    colorstart[colors[i] + 1]++;
+  }
+  for (c = 0; c < ncolors; c++) {
+    colorstart[c + 1] += colorstart[c];
+  }
+  std::vector<int> colorfill(colorstart.begin(), colorstart.end() - 1);
+  for (i = 0; i < npt; i++) {
+    colorlist[colorfill[colors[i]]++] = i;
+  }
+
+  // Move the vertices color by color.
+  std::vector<char> moved(npt, 0);
+  for (c = 0; c < ncolors; c++) {
+    int first = colorstart[c];
+    int n = colorstart[c + 1] - first;
+    int cthreads = nthreads < (n / 256 + 1) ? nthreads : (n / 256 + 1);
+    runthreads(this, cthreads, [&](int t) {
+      arraypool tetlist(sizeof(triface), 8);
+      for (int m = n * t / cthreads; m < n * (t + 1) / cthreads; m++) {
+        int idx = colorlist[first + m];
+        moved[idx] = move_vertex_unflipped(smpt_list[idx],
+            &(target_list[idx * 3]), &tetlist) ? 1 : 0;
+      }
+    });
+  }
+
+  if (b->verbose > 2) {
+    printf("      Moved %d vertices in %d colors.\n", npt, ncolors);
+  }
+
+  // Restore the Delaunay property.
+  for (i = 0; i < npt; i++) {
+    if (moved[i]) {
+      flip_vertex_star(smpt_list[i]);
+      if (later_unflip_queue->objects > b->unflip_queue_limit) {
+        recoverdelaunay();
+      }
+      movedcount++;
+    } else {
+      unmovedcount++;
+    }
+  }
 }
 
 //============================================================================//
@@ -30681,7 +31808,10 @@ void tetgenmesh::smooth_vertices()
       //} // if (st_facref_count > 0)
     }
 
-    if (((b->smooth_cirterion & 1) > 0)) { // default -s3
+    if (((b->smooth_cirterion & 1) > 0) && (b->num_threads > 0)) { // -j
+      smooth_vertices_colored(smpt_list, target_list, st_volref_count,
+                              movedcount, unmovedcount);
+    } else if (((b->smooth_cirterion & 1) > 0)) { // default -s3
       //if (st_volref_count > 0) {
       for (i = 0; i < st_volref_count; i++) {
         get_laplacian_center(smpt_list[i], &(target_list[i*3]));
@@ -31482,6 +32612,7 @@ long tetgenmesh::repair_badqual_tets(bool bFlips, bool bSmooth, bool bSteiners)
   long repaired_count = 0l;
 
   while (badqual_tets_pool->items > 0) {
+    checkprogress(-1.0);
   
     // Get a badtet of highest priority.
     badface *bt = top_badtet();
@@ -31693,6 +32824,33 @@ void tetgenmesh::improve_mesh()
 //                                                                            //
 //                                                                            //
 
+//============================================================================//
+//                                                                            //
+// reportprogress()    Report the progress to the user's callback.            //
+//                                                                            //
+// 'phase' is one of tetgenio::meshphase. It becomes the current phase, which //
+// is used by the subsequent calls of checkprogress(). If the callback asks   //
+// to stop, TetGen is terminated with the exit code 11.  Under TETLIBRARY     //
+// this throws, so all memory owned by this mesh is released by unwinding.    //
+// The time spent in the previous phase is recorded by timephase().           //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::reportprogress(int phase, REAL fraction)
+{
+  if (phase != progressphase) {
+    timephase();
+  }
+  progressphase = phase;
+  if ((in == NULL) || (in->progressfunc == NULL)) return;
+  if (!in->progressfunc(in->progresshandle, phase, fraction)) {
+    if (!b->quiet) {
+      printf("Meshing was cancelled in phase %d.\n", phase);
+    }
+    terminatetetgen(this, 11);
+  }
+}
+
 //============================================================================//
 //                                                                            //
 // printfcomma()    Print a (large) number with the 'thousands separator'.    //
@@ -33059,22 +34217,16 @@ void tetgenmesh::qualitystatistics()
 
 //============================================================================//
 //                                                                            //
-// memorystatistics()    Report the memory usage.                             //
+// memoryusage()    Return the memory (in bytes) taken at most by the mesh,   //
+//                  by the tet-to-subface/segment arrays and by the pools of  //
+//                  the algorithms.                                           //
 //                                                                            //
 //============================================================================//
 
-void tetgenmesh::memorystatistics()
+void tetgenmesh::memoryusage(unsigned long *meshmemory,
+                             unsigned long *t2shmemory,
+                             unsigned long *algomemory)
 {
-  printf("Memory usage statistics:\n\n");
- 
-  // Count the number of blocks of tetrahedra. 
-  int tetblocks = 0;
-  tetrahedrons->pathblock = tetrahedrons->firstblock;
-  while (tetrahedrons->pathblock != NULL) {
-    tetblocks++;
-    tetrahedrons->pathblock = (void **) *(tetrahedrons->pathblock);  
-  }
-
   // Calculate the total memory (in bytes) used by storing meshes.
   unsigned long totalmeshmemory = 0l, totalt2shmemory = 0l;
   totalmeshmemory = points->maxitems * points->itembytes +
@@ -33103,6 +34255,32 @@ void tetgenmesh::memorystatistics()
                         unflipqueue->totalmemory);
   }
 
+  *meshmemory = totalmeshmemory;
+  *t2shmemory = totalt2shmemory;
+  *algomemory = totalalgomemory;
+}
+
+//============================================================================//
+//                                                                            //
+// memorystatistics()    Report the memory usage.                             //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::memorystatistics()
+{
+  printf("Memory usage statistics:\n\n");
+ 
+  // Count the number of blocks of tetrahedra. 
+  int tetblocks = 0;
+  tetrahedrons->pathblock = tetrahedrons->firstblock;
+  while (tetrahedrons->pathblock != NULL) {
+    tetblocks++;
+    tetrahedrons->pathblock = (void **) *(tetrahedrons->pathblock);  
+  }
+
+  unsigned long totalmeshmemory, totalt2shmemory, totalalgomemory;
+  memoryusage(&totalmeshmemory, &totalt2shmemory, &totalalgomemory);
+
   printf("  Maximum number of tetrahedra:  %ld\n", tetrahedrons->maxitems);
   printf("  Maximum number of tet blocks (blocksize = %d):  %d\n",
          b->tetrahedraperblock, tetblocks);
@@ -33143,6 +34321,11 @@ void tetgenmesh::memorystatistics()
   printfcomma(totalmeshmemory + totalt2shmemory + totalalgomemory + 
               totalworkmemory);
   printf("\n");
+  printf("  Point and tetrahedron records (bytes):  %d, %d%s\n",
+         points->itembytes, tetrahedrons->itembytes,
+         b->compactmem ? " (compact)" : "");
+  printf("  Mesh memory per tetrahedron (bytes):  %.1f\n",
+         (REAL) (totalmeshmemory + totalt2shmemory) / tetrahedrons->items);
 
   printf("\n");
 }
@@ -33223,6 +34406,19 @@ void tetgenmesh::statistics()
   if (b->weighted) { // -w option
     printf("  Skipped non-regular points: %ld\n", nonregularcount);
   }
+  if ((b->verbose > 0) && (locatecount > 0l)) {
+    printf("  Point locations: %ld, %.1f tets walked on average\n",
+           locatecount, (REAL) locatesteps / locatecount);
+  }
+  if (b->verbose > 0) {
+    long counts[6];
+    predicatecounts(counts);
+    printf("  Predicates (exact): orient3d %ld (%ld), insphere %ld (%ld)",
+           counts[0] - predicatebase[0], counts[1] - predicatebase[1],
+           counts[2] - predicatebase[2], counts[3] - predicatebase[3]);
+    printf(", orient4d %ld (%ld)\n",
+           counts[4] - predicatebase[4], counts[5] - predicatebase[5]);
+  }
   printf("\n");
 
 
@@ -33238,6 +34434,135 @@ void tetgenmesh::statistics()
   }
 }
 
+//============================================================================//
+//                                                                            //
+// initstatistics()    Start the timing and counting of a run.                //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::initstatistics()
+{
+  countpredicates = (b->verbose > 0) || ((in != NULL) && in->countpredicates);
+  setpredicatecounting(countpredicates);
+  phasewall = walltime();
+  phasecpu = threadcputime();
+  predicatecounts(predicatebase);
+}
+
+//============================================================================//
+//                                                                            //
+// timephase()    Add the time since the last call to the current phase.      //
+//                                                                            //
+// The CPU time is the one of the thread running TetGen plus the one of the   //
+// threads started by runthreads() in the meantime.                           //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::timephase()
+{
+  REAL wall = walltime();
+  REAL cpu = threadcputime() + workercputime;
+
+  phasewalltime[progressphase] += wall - phasewall;
+  phasecputime[progressphase] += cpu - phasecpu;
+  phasewall = wall;
+  phasecpu = cpu;
+}
+
+//============================================================================//
+//                                                                            //
+// pausestatistics()    Stop the timing and counting between the stages of a  //
+//                      run, which may continue on another thread.            //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::pausestatistics()
+{
+  long counts[6];
+  int i;
+
+  timephase();
+  predicatecounts(counts);
+  for (i = 0; i < 6; i++) {
+    predicatebase[i] = counts[i] - predicatebase[i];
+  }
+}
+
+//============================================================================//
+//                                                                            //
+// resumestatistics()    Continue the timing and counting on the calling      //
+//                       thread, whose predicates are initialized first, the  //
+//                       same way transfernodes() did.                        //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::resumestatistics()
+{
+  long counts[6];
+  int i;
+
+  exactinit(0, b->noexact, b->nostaticfilter, xmax - xmin, ymax - ymin,
+            zmax - zmin);
+  setpredicatecounting(countpredicates);
+  predicatecounts(counts);
+  for (i = 0; i < 6; i++) {
+    predicatebase[i] = counts[i] - predicatebase[i];
+  }
+  phasewall = walltime();
+  phasecpu = threadcputime() + workercputime;
+}
+
+//============================================================================//
+//                                                                            //
+// outstatistics()    Output the statistics of the run (tetgenio::meshstats). //
+//                                                                            //
+//============================================================================//
+
+void tetgenmesh::outstatistics(tetgenio *out)
+{
+  tetgenio::meshstats *st = &(out->stats);
+  long counts[6];
+  int i;
+
+  timephase();
+  for (i = 0; i < tetgenio::MESH_PHASES; i++) {
+    st->walltime[i] = phasewalltime[i];
+    st->cputime[i] = phasecputime[i];
+  }
+
+  predicatecounts(counts);
+  st->orient3dcount = counts[0] - predicatebase[0];
+  st->orient3dexact = counts[1] - predicatebase[1];
+  st->inspherecount = counts[2] - predicatebase[2];
+  st->insphereexact = counts[3] - predicatebase[3];
+  st->orient4dcount = counts[4] - predicatebase[4];
+  st->orient4dexact = counts[5] - predicatebase[5];
+
+  st->flip23count = flip23count;
+  st->flip32count = flip32count;
+  st->flip44count = flip44count;
+  st->flip41count = flip41count;
+  st->flip14count = flip14count;
+  st->flip26count = flip26count;
+  st->flipn2ncount = flipn2ncount;
+  st->flip31count = flip31count;
+  st->flip22count = flip22count;
+  st->locatecount = locatecount;
+  st->locatesteps = locatesteps;
+  st->steinersegcount = st_segref_count;
+  st->steinerfaccount = st_facref_count;
+  st->steinervolcount = st_volref_count;
+
+  // The pools are incomplete if the run stopped before initializepools()
+  //   made its last one.
+  st->peakmemory = totalworkmemory;
+  if (cave_oldtet_list != (arraypool *) NULL) {
+    unsigned long meshmemory, t2shmemory, algomemory;
+    memoryusage(&meshmemory, &t2shmemory, &algomemory);
+    st->peakmemory += meshmemory + t2shmemory + algomemory;
+  }
+}
+
 //                                                                            //
 //                                                                            //
 //== meshstat_cxx ============================================================//
@@ -33790,6 +35115,7 @@ void tetgenmesh::outmetrics(tetgenio* out)
   i = 0;
 
   triface parenttet;
+  int parentindex;
   points->traversalinit();
   ptloop = pointtraverse();
   while (ptloop != (point) NULL) {
@@ -33798,10 +35124,12 @@ void tetgenmesh::outmetrics(tetgenio* out)
 	} else {
 	  decode(point2tet(ptloop), parenttet);
 	}
+    // -1 for a point not in the background mesh.
+    parentindex = (parenttet.tet != NULL) ? elemindex(parenttet.tet) : -1;
     if (out == (tetgenio *) NULL) {
-      fprintf(outfile, "%d  %d\n", pointindex, elemindex(parenttet.tet));
+      fprintf(outfile, "%d  %d\n", pointindex, parentindex);
     } else {
-      out->point2tetlist[i] = elemindex(parenttet.tet);
+      out->point2tetlist[i] = parentindex;
     }
 	pointindex++;
 	i++;
@@ -36115,32 +37443,43 @@ void tetgenmesh::out_intersected_facets()
 // - Write the output files and print the statistics.                         //
 // - Check the consistency of the mesh (-C).                                  //
 //                                                                            //
+// Under TETLIBRARY, a run stopped by terminatetetgen() (e.g., with the exit  //
+// code 11 when it is cancelled) still fills the statistics of 'out' up to    //
+// the point where it stopped before the exit code is thrown on.              //
+//                                                                            //
+// constrainmesh() runs the steps up to the carving of the holes and returns  //
+// false if the run ends there (-d), refinemesh() runs the others.  'tv' are  //
+// the wall-clock times of the steps.                                         //
+//                                                                            //
 //============================================================================//
 
-void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
-                    tetgenio *addin, tetgenio *bgmin)
+static bool constrainmesh(tetgenmesh &m, tetgenbehavior *b, tetgenio *in,
+                          tetgenio *out, tetgenio *addin, tetgenio *bgmin,
+                          REAL *tv)
 {
-  tetgenmesh m;
-  clock_t tv[13], ts[6]; // Timing informations (defined in time.h)
-  REAL cps = (REAL) CLOCKS_PER_SEC;
+  REAL ts[6]; // Wall-clock times in seconds.
 
-  tv[0] = clock();
+  tv[0] = walltime();
  
   m.b = b;
   m.in = in;
   m.addin = addin;
+  m.initstatistics();
 
   if (b->metric && bgmin && (bgmin->numberofpoints > 0)) {
     m.bgm = new tetgenmesh(); // Create an empty background mesh.
     m.bgm->b = b;
     m.bgm->in = bgmin;
+    m.bgm->countpredicates = m.countpredicates;
   }
 
   m.initializepools();
   m.transfernodes();
 
 
-  tv[1] = clock();
+  tv[1] = walltime();
+
+  m.reportprogress(tetgenio::MESH_DELAUNAY, 0.0);
 
   if (b->refine) { // -r
     m.reconstructmesh();
@@ -36148,66 +37487,78 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     m.incrementaldelaunay(ts[0]);
   }
 
-  tv[2] = clock();
+  tv[2] = walltime();
 
   if (!b->quiet) {
     if (b->refine) {
-      printf("Mesh reconstruction seconds:  %g\n", ((REAL)(tv[2]-tv[1])) / cps);
+      printf("Mesh reconstruction seconds:  %g\n", tv[2]-tv[1]);
     } else {
-      printf("Delaunay seconds:  %g\n", ((REAL)(tv[2]-tv[1])) / cps);
+      printf("Delaunay seconds:  %g\n", tv[2]-tv[1]);
       if (b->verbose) {
-        printf("  Point sorting seconds:  %g\n", ((REAL)(ts[0]-tv[1])) / cps);
+        printf("  Point sorting seconds:  %g\n", ts[0]-tv[1]);
 
       }
     }
   }
 
   if (b->plc && !b->refine) { // -p
+    m.reportprogress(tetgenio::MESH_SURFACE, 0.0);
     m.meshsurface();
 
-    ts[0] = clock();
+    ts[0] = walltime();
 
     if (!b->quiet) {
-      printf("Surface mesh seconds:  %g\n", ((REAL)(ts[0]-tv[2])) / cps);
+      printf("Surface mesh seconds:  %g\n", ts[0]-tv[2]);
     }
   }
 
 
-  tv[3] = clock();
+  tv[3] = walltime();
 
   if ((b->metric) && (m.bgm != NULL)) { // -m
     m.bgm->initializepools();
     m.bgm->transfernodes();
     m.bgm->reconstructmesh();
+    m.bgm->sizegrid_build();
 
-    ts[0] = clock();
+    ts[0] = walltime();
 
     if (!b->quiet) {
       printf("Background mesh reconstruct seconds:  %g\n",
-             ((REAL)(ts[0] - tv[3])) / cps);
+             ts[0] - tv[3]);
     }
 
     if (b->metric) { // -m
       m.interpolatemeshsize();
 
-      ts[1] = clock();
+      ts[1] = walltime();
 
       if (!b->quiet) {
-        printf("Size interpolating seconds:  %g\n",((REAL)(ts[1]-ts[0])) / cps);
+        printf("Size interpolating seconds:  %g\n",ts[1]-ts[0]);
       }
     }
+  } else if ((b->metric) && ((in->meshsizefunc != NULL) ||
+                             (in->meshsizegrid != NULL))) { // -m
+    m.interpolatemeshsize();
+
+    ts[1] = walltime();
+
+    if (!b->quiet) {
+      printf("Size interpolating seconds:  %g\n", ts[1] - tv[3]);
+    }
   }
 
-  tv[4] = clock();
+  tv[4] = walltime();
 
   if (b->plc && !b->refine) { // -p
+    m.reportprogress(tetgenio::MESH_BOUNDARY_RECOVERY, 0.0);
     if (!b->cdt) { // no -D
       m.recoverboundary(ts[0]);
     } else {
       m.constraineddelaunay(ts[0]);
     }
 
-    ts[1] = clock();
+    ts[1] = walltime();
 
     if (!b->quiet) {
       if (!b->cdt) { // no -D
@@ -36215,10 +37566,10 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
       } else {
         printf("Constrained Delaunay ");
       }
-      printf("seconds:  %g\n", ((REAL)(ts[1] - tv[4])) / cps);
+      printf("seconds:  %g\n", ts[1] - tv[4]);
       if (b->verbose) {
-        printf("  Segment recovery seconds:  %g\n",((REAL)(ts[0]-tv[4]))/ cps);
-        printf("  Facet recovery seconds:  %g\n", ((REAL)(ts[1]-ts[0])) / cps);
+        printf("  Segment recovery seconds:  %g\n",ts[0]-tv[4]);
+        printf("  Facet recovery seconds:  %g\n", ts[1]-ts[0]);
       }
     }
 
@@ -36244,24 +37595,28 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
       if (!b->quiet) {
         printf("\nThe input surface mesh is correct.\n");
       }
-      return;
+      if (out != (tetgenio *) NULL) {
+        m.outstatistics(out);
+      }
+      return false;
     }
 
+    m.reportprogress(tetgenio::MESH_CARVE_HOLES, 0.0);
     m.carveholes();
 
-    ts[2] = clock();
+    ts[2] = walltime();
 
     if (!b->quiet) {
-      printf("Exterior tets removal seconds:  %g\n",((REAL)(ts[2]-ts[1]))/cps);
+      printf("Exterior tets removal seconds:  %g\n",ts[2]-ts[1]);
     }
 
-    ts[3] = clock();
+    ts[3] = walltime();
 
     if ((!b->cdt || b->nobisect) && (b->supsteiner_level > 0)) { // no -D, -Y/1
       if (m.subvertstack->objects > 0l) {
         m.suppresssteinerpoints();
         if (!b->quiet) {
-          printf("Steiner suppression seconds:  %g\n", ((REAL)(ts[3]-ts[2]))/cps);
+          printf("Steiner suppression seconds:  %g\n", ts[3]-ts[2]);
         }
       }
     }
@@ -36278,17 +37633,24 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     }
   }
 
-  tv[5] = clock();
+  return true;
+}
+
+static void refinemesh(tetgenmesh &m, tetgenbehavior *b, tetgenio *in,
+                       tetgenio *out, tetgenio *addin, REAL *tv)
+{
+  tv[5] = walltime();
 
   if (b->metric || b->coarsen) { // -m or -R
+    m.reportprogress(tetgenio::MESH_COARSEN, 0.0);
     m.meshcoarsening();
   }
 
-  tv[6] = clock();
+  tv[6] = walltime();
 
   if (!b->quiet) {
     if (b->metric || b->coarsen) {
-      printf("Mesh coarsening seconds:  %g\n", ((REAL)(tv[6] - tv[5])) / cps);
+      printf("Mesh coarsening seconds:  %g\n", tv[6] - tv[5]);
     }
   }
 
@@ -36296,14 +37658,15 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     if (!b->quiet) {
       printf("Recovering Delaunayness...\n");
     }
+    m.reportprogress(tetgenio::MESH_DELAUNAY_RECOVERY, 0.0);
     m.recoverdelaunay();
   }
 
-  tv[7] = clock();
+  tv[7] = walltime();
 
   if (b->plc || (b->refine && b->quality && (in->refine_elem_list == NULL))) {
     if (!b->quiet) {
-      printf("Delaunay recovery seconds:  %g\n", ((REAL)(tv[7] - tv[6]))/cps);
+      printf("Delaunay recovery seconds:  %g\n", tv[7] - tv[6]);
     }
   }
 
@@ -36313,52 +37676,55 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     }
   }
 
-  tv[8] = clock();
+  tv[8] = walltime();
 
   if (!b->quiet) {
     if ((b->plc || b->refine) && b->insertaddpoints) { // -i
       if ((addin != NULL) && (addin->numberofpoints > 0)) {
-        printf("Constrained points seconds:  %g\n", ((REAL)(tv[8]-tv[7]))/cps);
+        printf("Constrained points seconds:  %g\n", tv[8]-tv[7]);
       }
     }
   }
   if (b->quality) { // -q
+    m.reportprogress(tetgenio::MESH_REFINEMENT, 0.0);
     m.delaunayrefinement();    
   }
 
-  tv[9] = clock();
+  tv[9] = walltime();
 
   if (!b->quiet) {
     if (b->quality) {
-      printf("Refinement seconds:  %g\n", ((REAL)(tv[9] - tv[8])) / cps);
+      printf("Refinement seconds:  %g\n", tv[9] - tv[8]);
     }
   }
 
   if ((b->plc || b->quality) &&
       (b->smooth_maxiter > 0) &&
       ((m.st_volref_count > 0) || (m.st_facref_count > 0))) {
+    m.reportprogress(tetgenio::MESH_SMOOTHING, 0.0);
     m.smooth_vertices(); // m.optimizemesh(ts[0]);
   }
 
-  tv[10] = clock();
+  tv[10] = walltime();
 
   if (!b->quiet) {
     if ((b->plc || b->quality) &&
         (b->smooth_maxiter > 0) &&
         ((m.st_volref_count > 0) || (m.st_facref_count > 0))) {
-      printf("Mesh smoothing seconds:  %g\n", ((REAL)(tv[10] - tv[9])) / cps);
+      printf("Mesh smoothing seconds:  %g\n", tv[10] - tv[9]);
     }
   }
 
   if (b->plc || b->quality) {
+    m.reportprogress(tetgenio::MESH_IMPROVEMENT, 0.0);
     m.improve_mesh();
   }
 
-  tv[11] = clock();
+  tv[11] = walltime();
 
   if (!b->quiet) {
     if (b->plc || b->quality) {
-      printf("Mesh improvement seconds:  %g\n", ((REAL)(tv[11] - tv[10])) / cps);
+      printf("Mesh improvement seconds:  %g\n", tv[11] - tv[10]);
     }
   }
 
@@ -36376,6 +37742,8 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     printf("\n");
   }
 
+  m.reportprogress(tetgenio::MESH_OUTPUT, 0.0);
+
   if (out != (tetgenio *) NULL) {
     out->firstnumber = in->firstnumber;
     out->mesh_dim = in->mesh_dim;
@@ -36469,12 +37837,16 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
     m.outvoronoi(out);
   }
 
+  if (out != (tetgenio *) NULL) {
+    m.outstatistics(out);
+  }
+
 
-  tv[12] = clock();
+  tv[12] = walltime();
 
   if (!b->quiet) {
-    printf("\nOutput seconds:  %g\n", ((REAL)(tv[12] - tv[11])) / cps);
-    printf("Total running seconds:  %g\n", ((REAL)(tv[12] - tv[0])) / cps);
+    printf("\nOutput seconds:  %g\n", tv[12] - tv[11]);
+    printf("Total running seconds:  %g\n", tv[12] - tv[0]);
   }
 
   if (b->docheck) {
@@ -36493,6 +37865,109 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
   }
 }
 
+static void tetrahedralizemesh(tetgenmesh &m, tetgenbehavior *b, tetgenio *in,
+                               tetgenio *out, tetgenio *addin, tetgenio *bgmin)
+{
+  REAL tv[13]; // Wall-clock times in seconds.
+
+  if (constrainmesh(m, b, in, out, addin, bgmin, tv)) {
+    refinemesh(m, b, in, out, addin, tv);
+  }
+}
+
+void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out,
+                    tetgenio *addin, tetgenio *bgmin)
+{
+  tetgenmesh m;
+
+#ifdef TETLIBRARY
+  try {
+    tetrahedralizemesh(m, b, in, out, addin, bgmin);
+  } catch (int) {
+    if (out != (tetgenio *) NULL) {
+      m.outstatistics(out);
+    }
+    throw;
+  }
+#else
+  tetrahedralizemesh(m, b, in, out, addin, bgmin);
+#endif
+}
+
+bool tetrahedralize_constrained(tetgenbehavior *b, tetgenio *in,
+                                tetgenio *out, tetgenmesh *m)
+{
+  REAL tv[13]; // Wall-clock times in seconds.
+  bool done;
+
+#ifdef TETLIBRARY
+  try {
+    done = !constrainmesh(*m, b, in, out, NULL, NULL, tv);
+  } catch (int) {
+    if (out != (tetgenio *) NULL) {
+      m->outstatistics(out);
+    }
+    throw;
+  }
+#else
+  done = !constrainmesh(*m, b, in, out, NULL, NULL, tv);
+#endif
+  if (done) {
+    return false;
+  }
+  m->pausestatistics();
+  return true;
+}
+
+void tetrahedralize_refine(tetgenbehavior *b, tetgenio *out, tetgenmesh *m)
+{
+  tetgenbehavior *mb = m->b;
+  REAL tv[13]; // Wall-clock times in seconds.
+
+  // Take the late switches.
+  mb->quality = b->quality;                                           // -q
+  mb->minratio = b->minratio;
+  mb->mindihedral = b->mindihedral;
+  mb->fixedvolume = b->fixedvolume;                                   // -a#
+  mb->maxvolume = b->maxvolume;
+  mb->maxvolume_length = b->maxvolume_length;
+  mb->opt_max_flip_level = b->opt_max_flip_level;                     // -O
+  mb->opt_scheme = b->opt_scheme;
+  mb->opt_iterations = b->opt_iterations;
+  mb->order = b->order;                                               // -o
+  mb->optmaxdihedral = b->optmaxdihedral;
+  mb->opt_max_asp_ratio = b->opt_max_asp_ratio;
+  mb->opt_max_edge_ratio = b->opt_max_edge_ratio;
+  mb->edgesout = b->edgesout;
+  mb->facesout = b->facesout;
+  mb->neighout = b->neighout;
+  mb->meditview = b->meditview;
+  mb->vtkview = b->vtkview;
+  mb->vtksurfview = b->vtksurfview;
+  mb->voroout = b->voroout;
+  mb->zeroindex = b->zeroindex;
+  mb->noiterationnum = b->noiterationnum;
+  mb->nojettison = b->nojettison;
+  mb->nobound = b->nobound;
+  strcpy(mb->outfilename, b->outfilename);
+
+  m->resumestatistics();
+  tv[0] = walltime();
+
+#ifdef TETLIBRARY
+  try {
+    refinemesh(*m, mb, m->in, out, NULL, tv);
+  } catch (int) {
+    if (out != (tetgenio *) NULL) {
+      m->outstatistics(out);
+    }
+    throw;
+  }
+#else
+  refinemesh(*m, mb, m->in, out, NULL, tv);
+#endif
+}
+
 #ifndef TETLIBRARY
 
 //============================================================================//
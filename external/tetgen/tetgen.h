@@ -173,6 +173,40 @@ public:
   // A callback function for mesh refinement.
   typedef bool (* TetSizeFunc)(REAL*, REAL*, REAL*, REAL*, REAL*, REAL);
 
+  // A callback function for the mesh size field (see meshsizefunc).
+  typedef REAL (* MeshSizeFunc)(void*, REAL, REAL, REAL);
+
+  // The phases of a TetGen run, reported to the progress callback.
+  enum meshphase {MESH_INIT, MESH_DELAUNAY, MESH_SURFACE, MESH_BOUNDARY_RECOVERY,
+                  MESH_CARVE_HOLES, MESH_COARSEN, MESH_DELAUNAY_RECOVERY,
+                  MESH_REFINEMENT, MESH_SMOOTHING, MESH_IMPROVEMENT,
+                  MESH_OUTPUT, MESH_PHASES};
+
+  // A callback function for progress reporting and cancellation.  It gets
+  //   'progresshandle', the current phase (a 'meshphase') and the finished
+  //   fraction of this phase in [0, 1] (or -1 if it is unknown).  Returning
+  //   false stops TetGen with the exit code 11.
+  typedef bool (* ProgressFunc)(void*, int, REAL);
+
+  // Statistics of the run, filled by tetrahedralize() in its output, also
+  //   when it stops with an exit code (up to that point).  The times of a phase (a 'meshphase') run from its report to the next one,
+  //   in seconds; 'cputime' adds up all threads working on the mesh.  Of the
+  //   predicate calls, the 'exact' ones were not decided by the floating
+  //   point filters.  'peakmemory' is the maximum size of the mesh and its
+  //   working pools, in bytes.
+  typedef struct {
+    REAL walltime[MESH_PHASES];
+    REAL cputime[MESH_PHASES];
+    long orient3dcount, orient3dexact;
+    long inspherecount, insphereexact;
+    long orient4dcount, orient4dexact;
+    long flip23count, flip32count, flip44count, flip41count;
+    long flip14count, flip26count, flipn2ncount, flip31count, flip22count;
+    long locatecount, locatesteps;
+    long steinersegcount, steinerfaccount, steinervolcount;
+    unsigned long peakmemory;
+  } meshstats;
+
   // Items are numbered starting from 'firstnumber' (0 or 1), default is 0.
   int firstnumber; 
 
@@ -275,6 +309,21 @@ public:
   REAL *segmentconstraintlist;
   int numberofsegmentconstraints;
 
+  // A mesh size field for the -m switch, used instead of a background mesh
+  //   (which takes precedence if given).  Either 'meshsizefunc' returns the
+  //   size at (x, y, z), getting 'meshsizehandle' first, or 'meshsizegrid'
+  //   holds the sizes at the nodes of a regular grid: 'meshsizegriddims'
+  //   nodes along x, y and z, x varying fastest, the first one at
+  //   'meshsizegridorigin', 'meshsizegridspacing' apart.  The grid is
+  //   interpolated trilinearly and clamped to its box.  Sizes <= 0 mean no
+  //   size there.  The function is called from one thread only.
+  REAL *meshsizegrid;
+  int meshsizegriddims[3];
+  REAL meshsizegridorigin[3];
+  REAL meshsizegridspacing[3];
+  void *meshsizehandle;
+  MeshSizeFunc meshsizefunc;
+
 
   // 'trifacelist':  An array of face (triangle) corners.  The first face's
   //   three corners are at indices [0], [1] and [2], followed by the remaining
@@ -333,6 +382,15 @@ public:
   // A callback function.
   TetSizeFunc tetunsuitable;
 
+  // Progress callback (called from the thread running TetGen).
+  void *progresshandle;
+  ProgressFunc progressfunc;
+
+  // Statistics of the run (see meshstats).  The predicate calls are only
+  //   counted if 'countpredicates' is set in the input, or with -V.
+  int countpredicates;
+  meshstats stats;
+
   // Input & output routines.
   bool load_node_call(FILE* infile, int markers, int uvflag, char*);
   bool load_node(char*);
@@ -437,6 +495,13 @@ public:
     segmentconstraintlist = (REAL *) NULL;
     numberofsegmentconstraints = 0;
 
+    meshsizegrid = (REAL *) NULL;
+    meshsizegriddims[0] = meshsizegriddims[1] = meshsizegriddims[2] = 0;
+    meshsizegridorigin[0] = meshsizegridorigin[1] = meshsizegridorigin[2] = 0.0;
+    meshsizegridspacing[0] = meshsizegridspacing[1] = meshsizegridspacing[2] = 0.0;
+    meshsizehandle = NULL;
+    meshsizefunc = NULL;
+
 
     vpointlist = (REAL *) NULL;
     vedgelist = (voroedge *) NULL;
@@ -450,6 +515,12 @@ public:
 
     tetunsuitable = NULL;
 
+    progresshandle = NULL;
+    progressfunc = NULL;
+
+    countpredicates = 0;
+    memset(&stats, 0, sizeof(stats));
+
     geomhandle = NULL;
     getvertexparamonedge = NULL;
     getsteineronedge = NULL;
@@ -569,6 +640,9 @@ public:
     if (segmentconstraintlist != (REAL *) NULL) {
       delete [] segmentconstraintlist;
     }
+    if (meshsizegrid != (REAL *) NULL) {
+      delete [] meshsizegrid;
+    }
     if (vpointlist != (REAL *) NULL) {
       delete [] vpointlist;
     }
@@ -679,6 +753,9 @@ public:
   int reversetetori;                                              // '-o/', 0.
   int steinerleft;                                                 // '-S', 0.
   int unflip_queue_limit;                                      // '-U#', 1000.
+  int num_threads;                                                 // '-j', 0.
+  int locate_grid;                                                 // '-G', 0.
+  int compactmem;                                                  // '-K', 0.
   int no_sort;                                                           // 0.
   int hilbert_order;                                           // '-b///', 52.
   int hilbert_limit;                                             // '-b//'  8.
@@ -798,6 +875,9 @@ public:
     reversetetori = 0;
     steinerleft = -1;
     unflip_queue_limit = 1000;
+    num_threads = 0;
+    locate_grid = 0;
+    compactmem = 0;
     no_sort = 0;
     hilbert_order = 52; //-1;
     hilbert_limit = 8;
@@ -852,14 +932,30 @@ public:
 // filter" in each predicate. It estimates the maximal possible error in all  //
 // cases.  It safely and quickly "filters" many easy cases.                   //
 //                                                                            //
+// orient3d_batch() and insphere_batch() evaluate the static filter of many   //
+// queries sharing their last point with SIMD instructions, and return the    //
+// same values as the scalar predicates.                                      //
+//                                                                            //
+// predicatecounts() returns the calls of orient3d(), insphere() and          //
+// orient4d() on the calling thread, each followed by the number of them      //
+// which needed exact arithmetic.  They are only counted after                //
+// setpredicatecounting(1) on that thread.                                    //
+//                                                                            //
 //============================================================================//
 
 void exactinit(int, int, int, REAL, REAL, REAL);
 
 REAL orient3d(REAL *pa, REAL *pb, REAL *pc, REAL *pd);
 REAL insphere(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe);
+void orient3d_batch(int n, REAL **pa, REAL **pb, REAL **pc, REAL *pd,
+                    REAL *det);
+void insphere_batch(int n, REAL **pa, REAL **pb, REAL **pc, REAL **pd,
+                    REAL *pe, REAL *det);
 REAL orient4d(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe,
               REAL ah, REAL bh, REAL ch, REAL dh, REAL eh);
+void predicatecounts(long *counts);
+void addpredicatecounts(const long *counts);
+void setpredicatecounting(int on);
 
 REAL orient2dexact(REAL *pa, REAL *pb, REAL *pc);
 REAL orient3dexact(REAL *pa, REAL *pb, REAL *pc, REAL *pd);
@@ -1113,12 +1209,14 @@ public:
     long items, maxitems;
     int  unallocateditems;
     int  pathitemsleft;
+    int  largepages;           // Blocks are backed by large pages ('-K').
 
     memorypool();
-    memorypool(int, int, int, int);
+    memorypool(int, int, int, int, int largepages = 0);
     ~memorypool();
     
-    void poolinit(int, int, int, int);
+    void poolinit(int, int, int, int, int largepages = 0);
+    void *allocblock();
     void restart();
     void *alloc();
     void dealloc(void*);
@@ -1422,6 +1520,20 @@ public:
   triface recenttet;
   face recentsh;
 
+  // A uniform grid keeping the last inserted vertex in each cell, to start
+  //   point location near the point (-G option).
+  point *locgrid;
+  int locgridsize[3];
+  REAL locgridcell;
+
+  // In a background mesh, a uniform grid listing the tets whose bounding box
+  //   meets each cell, to find the tet containing a point (-m option).  The
+  //   tets of cell i are sizegridtets[sizegridstart[i] .. sizegridstart[i+1]).
+  tetrahedron **sizegridtets;
+  long *sizegridstart;
+  int sizegridsize[3];
+  REAL sizegridcell;
+
   // PI is the ratio of a circle's circumference to its diameter.
   static REAL PI;
 
@@ -1453,6 +1565,7 @@ public:
   int useinsertradius;       // Save the insertion radius for Steiner points.
   long samples;               // Number of random samples for point location.
   unsigned long randomseed;                    // Current random number seed.
+  unsigned long long randomintseed;         // Random seed used by randomint().
   REAL cosmaxdihed, cosmindihed;    // The cosine values of max/min dihedral.
   REAL cossmtdihed;     // The cosine value of a bad dihedral to be smoothed.
   REAL cosslidihed;      // The cosine value of the max dihedral of a sliver.
@@ -1492,8 +1605,22 @@ public:
   long flip31count, flip22count;
   long opt_flips_count, opt_collapse_count, opt_smooth_count;
   long recover_delaunay_count;
+  long locatecount, locatesteps;       // Point locations and tets walked.
   unsigned long totalworkmemory;      // Total memory used by working arrays.
 
+  // Progress reporting (see tetgenio::progressfunc).
+  int  progressphase;                              // The current meshphase.
+  long progresstick;               // Counts calls of checkprogress() so far.
+
+  // Run statistics (see tetgenio::meshstats).
+  REAL phasewall, phasecpu;             // Times at the start of the phase.
+  REAL workercputime;              // CPU time of the threads of runthreads().
+  REAL phasewalltime[tetgenio::MESH_PHASES];
+  REAL phasecputime[tetgenio::MESH_PHASES];
+  long predicatebase[6];          // predicatecounts() at the start of a run,
+                                   //   the calls so far while it is paused.
+  int  countpredicates;             // The predicate calls are being counted.
+
 
 //============================================================================//
 //                                                                            //
@@ -1514,7 +1641,7 @@ public:
   static int sorgpivot [6], sdestpivot[6], sapexpivot[6];
   static int snextpivot[6];
 
-  void inittables();
+  static void inittables();
 
   // Primitives for tetrahedra.
   inline tetrahedron encode(triface& t);
@@ -1883,19 +2010,28 @@ public:
   int  hilbert_split(point* vertexarray, int arraysize, int gc0, int gc1,
                      REAL, REAL, REAL, REAL, REAL, REAL);
   void hilbert_sort3(point* vertexarray, int arraysize, int e, int d,
-                     REAL, REAL, REAL, REAL, REAL, REAL, int depth);
+                     REAL, REAL, REAL, REAL, REAL, REAL, int depth,
+                     int threads = 1);
   void brio_multiscale_sort(point*,int,int threshold,REAL ratio,int* depth);
 
   // Point location.
   unsigned long randomnation(unsigned int choices);
+  int  randomint();
   void randomsample(point searchpt, triface *searchtet);
+  void locgrid_init(int npoints);
+  void locgrid_insert(point pt);
+  void locgrid_seed(point searchpt, triface *searchtet);
+  void locgrid_free();
+  void sizegrid_build();
+  int  sizegrid_locate(point searchpt, triface *searchtet);
+  void sizegrid_free();
   enum locateresult locate(point searchpt, triface *searchtet, int chkencflag = 0);
 
   // Incremental Delaunay construction.
   enum locateresult locate_dt(point searchpt, triface *searchtet);
   int  insert_vertex_bw(point, triface*, insertvertexflags*);
   void initialdelaunay(point pa, point pb, point pc, point pd);
-  void incrementaldelaunay(clock_t&);
+  void incrementaldelaunay(REAL&);
 
 //============================================================================//
 //                                                                            //
@@ -2014,7 +2150,7 @@ public:
                     arraypool*, arraypool*);
   void constrainedfacets();  
 
-  void constraineddelaunay(clock_t&);
+  void constraineddelaunay(REAL&);
 
 //============================================================================//
 //                                                                            //
@@ -2054,7 +2190,7 @@ public:
   int suppressbdrysteinerpoint(point steinerpt);
   int suppresssteinerpoints();
 
-  void recoverboundary(clock_t&);
+  void recoverboundary(REAL&);
 
 //============================================================================//
 //                                                                            //
@@ -2070,6 +2206,7 @@ public:
   int  search_edge(point p0, point p1, triface &tetloop);
   int  scout_point(point, triface*, int randflag);
   REAL getpointmeshsize(point, triface*, int iloc);
+  REAL getfieldmeshsize(point);
   void interpolatemeshsize();
 
   void insertconstrainedpoints(point *insertarray, int arylen, int rejflag);
@@ -2172,7 +2309,15 @@ public:
   int  get_seg_laplacian_center(point mesh_vert, REAL target[3]);
   int  get_surf_laplacian_center(point mesh_vert, REAL target[3]);
   int  get_laplacian_center(point mesh_vert, REAL target[3]);
+  bool star_orient_valid(arraypool* tetlist, REAL* newpos);
   bool move_vertex(point mesh_vert, REAL target[3]);
+  void flip_vertex_star(point mesh_vert);
+  int  getvertexstar_unmarked(point searchpt, arraypool* tetlist,
+                              arraypool* vertlist);
+  bool move_vertex_unflipped(point mesh_vert, REAL target[3],
+                             arraypool* tetlist);
+  void smooth_vertices_colored(point *smpt_list, REAL *target_list, int npt,
+                               int &movedcount, int &unmovedcount);
   void smooth_vertices();
 
   bool get_tet(point, point, point, point, triface *);
@@ -2202,11 +2347,21 @@ public:
   int check_regular(int);
   int check_conforming(int);
 
+  // Progress reporting and cancellation.
+  void reportprogress(int phase, REAL fraction);
+  inline void checkprogress(REAL fraction);
+
   //  Mesh statistics.
   void printfcomma(unsigned long n);
   void qualitystatistics();
+  void memoryusage(unsigned long*, unsigned long*, unsigned long*);
   void memorystatistics();
   void statistics();
+  void initstatistics();
+  void timephase();
+  void pausestatistics();
+  void resumestatistics();
+  void outstatistics(tetgenio*);
 
 //============================================================================//
 //                                                                            //
@@ -2293,6 +2448,15 @@ public:
     subdomains = 0;
     subdomain_markers = NULL;
 
+    locgrid = NULL;
+    locgridsize[0] = locgridsize[1] = locgridsize[2] = 0;
+    locgridcell = 0.0;
+
+    sizegridtets = NULL;
+    sizegridstart = NULL;
+    sizegridsize[0] = sizegridsize[1] = sizegridsize[2] = 0;
+    sizegridcell = 0.0;
+
     numpointattrib = numelemattrib = 0;
     sizeoftensor = 0;
     pointmtrindex = 0;
@@ -2314,6 +2478,7 @@ public:
     useinsertradius = 0;
     samples = 0l;
     randomseed = 1l;
+    randomintseed = 1ull;
     minfaceang = minfacetdihed = PI;
     cos_facet_separate_ang_tol = cos(179.9/180.*PI);
     cos_collinear_ang_tol = cos(179.9/180.*PI);
@@ -2343,9 +2508,22 @@ public:
     flip23count = flip32count = flip44count = flip41count = 0l;
     flip22count = flip31count = 0l;
     recover_delaunay_count = 0l;
+    locatecount = locatesteps = 0l;
     opt_flips_count = opt_collapse_count = opt_smooth_count = 0l;
     totalworkmemory = 0l;
 
+    progressphase = 0;
+    progresstick = 0l;
+
+    phasewall = phasecpu = workercputime = 0.0;
+    countpredicates = 0;
+    for (int i = 0; i < tetgenio::MESH_PHASES; i++) {
+      phasewalltime[i] = phasecputime[i] = 0.0;
+    }
+    for (int i = 0; i < 6; i++) {
+      predicatebase[i] = 0l;
+    }
+
   } // tetgenmesh()
 
   void freememory()
@@ -2439,6 +2617,14 @@ public:
       delete [] subdomain_markers;
     }
 
+    if (locgrid != NULL) {
+      delete [] locgrid;
+    }
+    if (sizegridtets != NULL) {
+      delete [] sizegridtets;
+      delete [] sizegridstart;
+    }
+
     initializetetgenmesh();
   }
 
@@ -2471,6 +2657,31 @@ public:
 void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out, 
                     tetgenio *addin = NULL, tetgenio *bgmin = NULL);
 
+//============================================================================//
+//                                                                            //
+// tetrahedralize_constrained()    The first stage of tetrahedralize(), which //
+//                                 makes the constrained Delaunay tetrahed-   //
+//                                 ralization of a PLC (-p) and carves it.    //
+// tetrahedralize_refine()    The second stage, which refines, improves and   //
+//                            outputs the mesh.                               //
+//                                                                            //
+// They let a PLC be meshed again with other late switches without making its //
+// constrained mesh again: -q, -a#, -O, -o, and the output switches -e, -f,   //
+// -n, -g, -k, -v, -z, -I, -J and -B.  'm' is an empty tetgenmesh for the     //
+// first stage, which returns false if the run ends there (-d); only such a   //
+// run writes to 'out'.  The second stage uses up 'm'.  Its 'b' may differ    //
+// from the one of the first stage only in the late switches, which it copies //
+// into the first one, so that one must outlive 'm' (TetGen also adjusts some //
+// of its tolerances on the way).  The stages may run on different threads,   //
+// and together they give the same output and statistics as tetrahedralize()  //
+// without 'addin' and 'bgmin', the time between them excepted.               //
+//                                                                            //
+//============================================================================//
+
+bool tetrahedralize_constrained(tetgenbehavior *b, tetgenio *in,
+                                tetgenio *out, tetgenmesh *m);
+void tetrahedralize_refine(tetgenbehavior *b, tetgenio *out, tetgenmesh *m);
+
 #ifdef TETLIBRARY
 void tetrahedralize(char *switches, tetgenio *in, tetgenio *out,
                     tetgenio *addin = NULL, tetgenio *bgmin = NULL);
@@ -2516,6 +2727,9 @@ inline void terminatetetgen(tetgenmesh *m, int x)
   case 10:
     printf("An input error was detected. Program stopped.\n"); 
     break;
+  case 11:
+    printf("Meshing was cancelled. Program stopped.\n");
+    break;
   case 200:
     printf("Boundary contains Steiner points (-YY option). Program stopped.\n");
     break;
@@ -3569,6 +3783,18 @@ inline tetgenmesh::point tetgenmesh::farsdest(face& s)
   return sdest(travesh);
 }
 
+// checkprogress()    Report progress of the current phase every 1024 calls.
+//   It is cheap enough to be called once per iteration of the main loops.
+
+inline void tetgenmesh::checkprogress(REAL fraction)
+{
+  if ((in != NULL) && (in->progressfunc != NULL)) {
+    if ((++progresstick & 1023l) == 0l) {
+      reportprogress(progressphase, fraction);
+    }
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // Linear algebra operators.                                                 //
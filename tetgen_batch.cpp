@@ -0,0 +1,326 @@
+#include "tetgen_batch.h"
+#include "tetgen_utils.h"
+#include "tetgen_reorder.h"
+
+#include <igl/readOFF.h>
+#include <igl/readPLY.h>
+#include <igl/readSTL.h>
+#include <igl/remove_unreferenced.h>
+#include <fmt/ostream.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct batch_job
+{
+  std::string input;
+  std::string output;
+
+  std::string status = "pending";
+  int n_vertices = 0;
+  int n_tets = 0;
+  double load_sec = 0.;
+  double mesh_sec = 0.;
+  double export_sec = 0.;
+  mesh_locality before; // vertex locality before and after reordering
+  mesh_locality after;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static std::string default_output(const std::string input, const std::string outdir,
+    const std::string ext)
+{
+  std::string name = input;
+  size_t dot = name.find_last_of('.');
+  size_t slash = name.find_last_of("/\\");
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    name = name.substr(0, dot);
+  name += ext;
+
+  if (outdir.empty())
+    return name;
+  if (slash != std::string::npos)
+    name = name.substr(slash + 1);
+  return outdir + "/" + name;
+}
+
+static bool read_manifest(const std::string filename, const std::string outdir,
+    const std::string ext, std::vector<batch_job>& jobs)
+{
+  std::ifstream in(filename);
+  if (!in.is_open())
+    return false;
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream ls(line);
+    batch_job job;
+    if (!(ls >> job.input) || job.input[0] == '#')
+      continue;
+    if (!(ls >> job.output))
+      job.output = default_output(job.input, outdir, ext);
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+// job_threads are the threads of one job for converting and exporting its
+// mesh, so that the concurrent jobs together use about all cores
+static void run_job(batch_job& job, const std::string switches,
+    mesh_order order, int job_threads)
+{
+  auto t0 = std::chrono::steady_clock::now();
+
+  tetgenio in;
+  if (!read_tetgenio(job.input, in))
+  {
+    job.status = "load failed";
+    return;
+  }
+  job.load_sec = seconds_since(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  dMat V;
+  iMat T;
+  iVec TX;
+  int info = tetrahedralize_tetgenio(&in, switches, V, T, TX, nullptr,
+      job_threads);
+  job.mesh_sec = seconds_since(t0);
+  if (info != 0)
+  {
+    job.status = fmt::format("tetgen failed ({:d})", info);
+    return;
+  }
+
+  t0 = std::chrono::steady_clock::now();
+  dMat V_exp;
+  iMat T_exp, I, J;
+  igl::remove_unreferenced(V, T, V_exp, T_exp, I, J);
+  job.n_vertices = V_exp.rows();
+  job.n_tets = T_exp.rows();
+  if (order != mesh_order::none)
+  {
+    job.before = measure_locality(T_exp);
+    reorder_tet_mesh(order, V_exp, T_exp, TX);
+    job.after = measure_locality(T_exp);
+  }
+  if (!write_tet_mesh(job.output, V_exp, T_exp, TX, true, job_threads))
+  {
+    job.status = "export failed";
+    return;
+  }
+  job.export_sec = seconds_since(t0);
+  job.status = "ok";
+}
+
+static void print_usage()
+{
+  printf("Usage: tetgen_gui --batch <manifest> [-p switches] [-j threads]"
+      " [-o outdir] [-r report.csv] [-b]\n"
+      "       [-s none|hilbert|rcm]\n");
+}
+
+int run_batch(int argc, char* argv[])
+{
+  std::string manifest;
+  std::string switches = "pqAa1e-1Q";
+  std::string outdir;
+  std::string report;
+  std::string ext = ".vtx";
+  mesh_order order = mesh_order::none;
+  int n_threads = std::thread::hardware_concurrency();
+
+  for (int i = 0; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "-p" && has_value)
+      switches = argv[++i];
+    else if (arg == "-j" && has_value)
+      n_threads = std::atoi(argv[++i]);
+    else if (arg == "-o" && has_value)
+      outdir = argv[++i];
+    else if (arg == "-r" && has_value)
+      report = argv[++i];
+    else if (arg == "-b")
+      ext = ".vtxb";
+    else if (arg == "-s" && has_value && parse_mesh_order(argv[i + 1], order))
+      i++;
+    else if (manifest.empty() && arg[0] != '-')
+      manifest = arg;
+    else
+    {
+      print_usage();
+      return 1;
+    }
+  }
+  if (manifest.empty())
+  {
+    print_usage();
+    return 1;
+  }
+
+  std::vector<batch_job> jobs;
+  if (!read_manifest(manifest, outdir, ext, jobs))
+  {
+    printf("Fail to read manifest %s\n", manifest.c_str());
+    return 1;
+  }
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > (int)jobs.size())
+    n_threads = std::max<int>(1, jobs.size());
+
+  printf("Meshing %d files with [-%s] on %d threads.\n",
+      (int)jobs.size(), switches.c_str(), n_threads);
+
+  // each worker takes the next job until none is left
+  int job_threads = std::max(1,
+      (int)std::thread::hardware_concurrency() / n_threads);
+  auto t0 = std::chrono::steady_clock::now();
+  std::atomic<size_t> next_job(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < n_threads; t++)
+  {
+    workers.emplace_back([&]()
+    {
+      size_t i;
+      while ((i = next_job++) < jobs.size())
+        run_job(jobs[i], switches, order, job_threads);
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  double total_sec = seconds_since(t0);
+
+  // summary
+  int n_failed = 0;
+  fmt::print("\n{:<32} {:<20} {:>10} {:>10} {:>9} {:>9} {:>9}\n",
+      "input", "status", "vertices", "tets", "load(s)", "mesh(s)", "export(s)");
+  for (const auto& job : jobs)
+  {
+    fmt::print("{:<32} {:<20} {:>10d} {:>10d} {:>9.3f} {:>9.3f} {:>9.3f}\n",
+        job.input, job.status, job.n_vertices, job.n_tets,
+        job.load_sec, job.mesh_sec, job.export_sec);
+    if (job.status != "ok")
+      n_failed++;
+  }
+  if (order != mesh_order::none)
+  {
+    fmt::print("\nvertices reordered by {}, before -> after\n{:<32} {:>21} {:>21}"
+        " {:>21} {:>21}\n", mesh_order_name(order), "input", "bandwidth",
+        "edge span", "tet span", "tet stride");
+    for (const auto& job : jobs)
+    {
+      if (job.status != "ok")
+        continue;
+      fmt::print("{:<32} {:>10d}>{:>10d} {:>10.1f}>{:>10.1f} {:>10.1f}>{:>10.1f}"
+          " {:>10.1f}>{:>10.1f}\n", job.input,
+          job.before.bandwidth, job.after.bandwidth,
+          job.before.edge_span, job.after.edge_span,
+          job.before.tet_span, job.after.tet_span,
+          job.before.tet_stride, job.after.tet_stride);
+    }
+  }
+  fmt::print("{:d} of {:d} jobs succeeded in {:.3f} seconds.\n",
+      (int)jobs.size() - n_failed, (int)jobs.size(), total_sec);
+
+  if (!report.empty())
+  {
+    std::ofstream out(report, std::ofstream::out | std::ofstream::trunc);
+    fmt::print(out, "input,output,status,vertices,tets,load_sec,mesh_sec,export_sec\n");
+    for (const auto& job : jobs)
+      fmt::print(out, "{},{},{},{:d},{:d},{:f},{:f},{:f}\n",
+          job.input, job.output, job.status, job.n_vertices, job.n_tets,
+          job.load_sec, job.mesh_sec, job.export_sec);
+  }
+
+  return n_failed;
+}
+
+// the loading done before load_mesh: a viewer copy by igl and a second parse
+// by tetgenio
+static bool load_twice(const std::string filename, dMat& V, iMat& F, tetgenio& io)
+{
+  std::vector<char> f_tmp(filename.begin(), filename.end());
+  f_tmp.push_back('\0');
+  std::string ext = filename.substr(filename.find_last_of('.') + 1);
+  if (ext == "off")
+    return igl::readOFF(filename, V, F) && io.load_off(f_tmp.data());
+  if (ext == "ply")
+    return igl::readPLY(filename, V, F) && io.load_ply(f_tmp.data());
+  if (ext == "stl")
+  {
+    dMat N;
+    return igl::readSTL(filename, V, F, N) && io.load_stl(f_tmp.data());
+  }
+  return false;
+}
+
+int run_bench_load(int argc, char* argv[])
+{
+  int repeats = 5;
+  std::vector<std::string> files;
+  for (int i = 0; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc)
+      repeats = std::max(1, std::atoi(argv[++i]));
+    else
+      files.push_back(arg);
+  }
+  if (files.empty())
+  {
+    printf("Usage: tetgen_gui --bench-load [-n repeats] <mesh files>\n");
+    return 1;
+  }
+
+  int n_failed = 0;
+  fmt::print("{:<32} {:>10} {:>10} {:>12} {:>10} {:>10} {:>12} {:>8}\n",
+      "input", "vertices", "faces", "twice(s)", "vertices", "faces", "once(s)",
+      "speedup");
+  for (const auto& file : files)
+  {
+    dMat V0, V1;
+    iMat F0, F1;
+    double twice_sec = 1e30, once_sec = 1e30;
+    bool ok = true;
+    for (int r = 0; r < repeats && ok; r++)
+    {
+      auto t0 = std::chrono::steady_clock::now();
+      {
+        tetgenio io;
+        ok = load_twice(file, V0, F0, io);
+      }
+      twice_sec = std::min(twice_sec, seconds_since(t0));
+
+      t0 = std::chrono::steady_clock::now();
+      {
+        tetgenio io;
+        mesh_polygons polygons;
+        ok = ok && load_mesh(file, V1, F1, &polygons) &&
+          mesh_to_tetgenio(V1, F1, io, &polygons);
+      }
+      once_sec = std::min(once_sec, seconds_since(t0));
+    }
+    if (!ok)
+    {
+      fmt::print("{:<32} load failed\n", file);
+      n_failed++;
+      continue;
+    }
+    fmt::print("{:<32} {:>10d} {:>10d} {:>12.4f} {:>10d} {:>10d} {:>12.4f} {:>7.2f}x\n",
+        file, V0.rows(), F0.rows(), twice_sec, V1.rows(), F1.rows(), once_sec,
+        twice_sec / once_sec);
+  }
+  return n_failed;
+}
@@ -0,0 +1,27 @@
+#ifndef TETGEN_BATCH_H
+#define TETGEN_BATCH_H
+
+// Headless batch mode, run as
+//
+//   tetgen_gui --batch <manifest> [-p switches] [-j threads] [-o outdir]
+//              [-r report.csv] [-b] [-s none|hilbert|rcm]
+//
+// Each non-empty line of the manifest not starting with '#' is a job
+// "<input> [<output>]". Without an output, the .vtx file (.vtxb with -b) is
+// written next to the input (or into outdir) with the extension replaced.
+// Outputs ending with .vtxb are written in the binary format. With -s the
+// vertices and tets are renumbered for locality (see tetgen_reorder.h) and
+// the locality before and after is printed. Jobs are meshed concurrently
+// with their own tetgenio, and a per-job summary of status and timings is
+// printed at the end. Returns the number of failed jobs.
+int run_batch(int argc, char* argv[]);
+
+// Compare the time to load meshes with load_mesh() and mesh_to_tetgenio()
+// against reading them with igl and tetgenio separately, run as
+//
+//   tetgen_gui --bench-load [-n repeats] <mesh files>
+//
+// The best of the repeats is reported. Returns the number of failed files.
+int run_bench_load(int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,582 @@
+// Benchmark of the meshing pipeline, run as
+//
+//   tetgen_bench [-d data dir] [-n repeats] [-s scale] [-o results.csv]
+//                [-b baseline.csv] [-t tolerance] [-w work dir]
+//   tetgen_bench --self-test [-w work dir]
+//
+// The bundled meshes (bunny.off, cylinder.ply, finger.stl, couple_square.stl
+// in the data dir, the source dir by default) and generated inputs, a random
+// point cloud and a sphere, go through the stages
+//
+//   load            load_mesh() and mesh_to_tetgenio(), as the GUI does
+//   load_tetgen     tetgenio::load_off/load_ply/load_stl
+//   tetrahedralize  tetgen with each switch preset, and the time of every
+//                   tetgen phase from tetgenio::stats as "tetgen:<phase>"
+//   convert         convert_tetgenio(), as tetrahedralize_tetgenio() does
+//   export_vtx      write_vtx()
+//   export_vtxb     write_vtxb()
+//
+// The best wall time of the repeats, the tets per second and the peak
+// resident memory of each stage are printed and written as csv to the file
+// given by -o. Such a file given by -b is the baseline: stages which got
+// slower or bigger by more than the tolerance (0.2 by default) are reported
+// as regressions. -s scales the generated inputs and the volume bound of the
+// "fine" preset. Returns the number of failures and regressions.
+//
+// --self-test checks the comparison with the baseline on a small sphere, and
+// is run by ctest.
+
+#include "tetgen_utils.h"
+
+#include <fmt/ostream.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#ifndef TETGEN_BENCH_DATA
+#define TETGEN_BENCH_DATA "."
+#endif
+
+struct bench_result
+{
+  std::string input;
+  std::string preset;
+  std::string stage;
+  std::string switches;
+  int tets = 0;
+  double sec = 1e30;  // best of the repeats
+  long rss_kb = 0;    // largest peak of the repeats
+};
+
+struct bench_input
+{
+  std::string name;
+  std::string file; // empty for generated inputs
+  dMat V;           // generated surface, or points without faces
+  iMat F;
+};
+
+struct bench_preset
+{
+  std::string name;
+  std::string switches;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// Let the peak resident memory start again from the current one, where the
+// kernel allows it
+static void reset_peak_rss()
+{
+#ifdef __linux__
+  std::ofstream f("/proc/self/clear_refs");
+  if (f.is_open())
+    f << "5";
+#endif
+}
+
+static long peak_rss_kb()
+{
+#ifdef __linux__
+  std::ifstream f("/proc/self/status");
+  std::string line;
+  while (std::getline(f, line))
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::atol(line.c_str() + 6);
+#endif
+#ifndef _WIN32
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+static bench_result& result_of(std::vector<bench_result>& results,
+    const std::string input, const std::string preset, const std::string stage)
+{
+  for (auto& r : results)
+    if (r.input == input && r.preset == preset && r.stage == stage)
+      return r;
+  results.push_back(bench_result());
+  results.back().input = input;
+  results.back().preset = preset;
+  results.back().stage = stage;
+  return results.back();
+}
+
+// Time f() into r, which keeps the best time and the largest peak memory
+template <typename Func>
+static bool measure(bench_result& r, Func f)
+{
+  reset_peak_rss();
+  auto t0 = std::chrono::steady_clock::now();
+  bool ok = f();
+  r.sec = std::min(r.sec, seconds_since(t0));
+  r.rss_kb = std::max(r.rss_kb, peak_rss_kb());
+  return ok;
+}
+
+// Unit sphere by subdividing an icosahedron
+static void make_sphere(int levels, dMat& V, iMat& F)
+{
+  const double t = (1. + std::sqrt(5.)) / 2.;
+  std::vector<Eigen::RowVector3d> verts = {
+    {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+    {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+    {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+  std::vector<std::array<int, 3>> faces = {
+    {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+    {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+    {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+    {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+  for (auto& v : verts)
+    v.normalize();
+
+  for (int l = 0; l < levels; l++)
+  {
+    std::map<std::pair<int, int>, int> midpoints;
+    auto midpoint = [&](int a, int b)
+    {
+      auto key = std::make_pair(std::min(a, b), std::max(a, b));
+      auto it = midpoints.find(key);
+      if (it != midpoints.end())
+        return it->second;
+      verts.push_back((verts[a] + verts[b]).normalized());
+      midpoints[key] = (int)verts.size() - 1;
+      return (int)verts.size() - 1;
+    };
+    std::vector<std::array<int, 3>> finer;
+    for (const auto& f : faces)
+    {
+      int ab = midpoint(f[0], f[1]), bc = midpoint(f[1], f[2]),
+          ca = midpoint(f[2], f[0]);
+      finer.push_back({f[0], ab, ca});
+      finer.push_back({f[1], bc, ab});
+      finer.push_back({f[2], ca, bc});
+      finer.push_back({ab, bc, ca});
+    }
+    faces.swap(finer);
+  }
+
+  V.resize(verts.size(), 3);
+  for (size_t i = 0; i < verts.size(); i++)
+    V.row(i) = verts[i];
+  F.resize(faces.size(), 3);
+  for (size_t i = 0; i < faces.size(); i++)
+    F.row(i) << faces[i][0], faces[i][1], faces[i][2];
+}
+
+static void make_point_cloud(int n, dMat& V)
+{
+  std::mt19937_64 random(1);
+  std::uniform_real_distribution<double> unit(0., 1.);
+  V.resize(n, 3);
+  for (int i = 0; i < n; i++)
+    for (int k = 0; k < 3; k++)
+      V(i, k) = unit(random);
+}
+
+static bool points_to_tetgenio(const dMat& V, tetgenio& io)
+{
+  io.firstnumber = 0;
+  io.numberofpoints = V.rows();
+  io.pointlist = new REAL[V.size()];
+  for (int i = 0; i < V.rows(); i++)
+    for (int k = 0; k < 3; k++)
+      io.pointlist[3 * i + k] = V(i, k);
+  return true;
+}
+
+// The tetgenio parsers for the extension of the file
+static bool load_tetgen(const std::string filename, tetgenio& io)
+{
+  std::vector<char> f_tmp(filename.begin(), filename.end());
+  f_tmp.push_back('\0');
+  std::string ext = filename.substr(filename.find_last_of('.') + 1);
+  if (ext == "off")
+    return io.load_off(f_tmp.data());
+  if (ext == "ply")
+    return io.load_ply(f_tmp.data());
+  if (ext == "stl")
+    return io.load_stl(f_tmp.data());
+  return false;
+}
+
+// Surfaces get the plc, quality and fine presets, the last one with a volume
+// bound making about 50000 * scale tets in the bounding box
+static std::vector<bench_preset> presets_of(const tetgenio& io, bool surface,
+    double scale)
+{
+  if (!surface)
+    return {{"delaunay", "Q"}};
+
+  Eigen::Map<const Eigen::Matrix<REAL, Eigen::Dynamic, 3, Eigen::RowMajor>>
+      P(io.pointlist, io.numberofpoints, 3);
+  double box = (P.colwise().maxCoeff() - P.colwise().minCoeff()).prod();
+  return {
+    {"plc", "pQ"},
+    {"quality", "pqAQ"},
+    {"fine", fmt::format("pq1.2a{:.3g}AQ", box / (50000. * scale))}};
+}
+
+static void run_preset(std::vector<bench_result>& results,
+    const bench_input& input, tetgenio& in, const bench_preset& preset,
+    const std::string workdir, int& n_failed)
+{
+  static const char* phases[tetgenio::MESH_PHASES] = {
+    "init", "delaunay", "surface", "boundary_recovery", "carve_holes",
+    "coarsen", "delaunay_recovery", "refinement", "smoothing", "improvement",
+    "output"};
+
+  auto& r_tet = result_of(results, input.name, preset.name, "tetrahedralize");
+  r_tet.switches = preset.switches;
+  tetgenio out;
+  bool ok = measure(r_tet, [&]()
+  {
+    std::vector<char> switches(preset.switches.begin(), preset.switches.end());
+    switches.push_back('\0');
+    try
+    {
+      ::tetrahedralize(switches.data(), &in, &out);
+    }
+    catch (int)
+    {
+      return false;
+    }
+    return out.numberoftetrahedra > 0;
+  });
+  if (!ok)
+  {
+    fmt::print("{} [-{}]: tetgen failed\n", input.name, preset.switches);
+    n_failed++;
+    return;
+  }
+  r_tet.tets = out.numberoftetrahedra;
+  for (int i = 0; i < tetgenio::MESH_PHASES; i++)
+  {
+    if (out.stats.walltime[i] <= 0.)
+      continue;
+    auto& r = result_of(results, input.name, preset.name,
+        std::string("tetgen:") + phases[i]);
+    r.switches = preset.switches;
+    r.sec = std::min(r.sec, (double)out.stats.walltime[i]);
+  }
+
+  dMat V;
+  iMat T;
+  iVec TX;
+  auto& r_conv = result_of(results, input.name, preset.name, "convert");
+  r_conv.switches = preset.switches;
+  r_conv.tets = r_tet.tets;
+  measure(r_conv, [&]() { return convert_tetgenio(out, V, T, TX) == 0; });
+
+  const std::string stages[2] = {"export_vtx", "export_vtxb"};
+  for (const auto& stage : stages)
+  {
+    std::string file = workdir + "/tetgen_bench." + stage.substr(7);
+    auto& r = result_of(results, input.name, preset.name, stage);
+    r.switches = preset.switches;
+    r.tets = r_tet.tets;
+    if (!measure(r, [&]() { return write_tet_mesh(file, V, T, TX, true); }))
+    {
+      fmt::print("{} [-{}]: {} failed\n", input.name, preset.switches, stage);
+      n_failed++;
+    }
+    std::remove(file.c_str());
+  }
+}
+
+static bool write_results(const std::string filename,
+    const std::vector<bench_result>& results)
+{
+  std::ofstream out(filename, std::ofstream::out | std::ofstream::trunc);
+  if (!out.is_open())
+    return false;
+  fmt::print(out, "input,preset,stage,switches,tets,seconds,tets_per_sec,peak_rss_kb\n");
+  for (const auto& r : results)
+    fmt::print(out, "{},{},{},{},{:d},{:f},{:f},{:d}\n", r.input, r.preset,
+        r.stage, r.switches, r.tets, r.sec,
+        r.tets > 0 ? r.tets / r.sec : 0., r.rss_kb);
+  return true;
+}
+
+static bool read_results(const std::string filename,
+    std::vector<bench_result>& results)
+{
+  std::ifstream in(filename);
+  std::string line;
+  if (!in.is_open() || !std::getline(in, line))
+    return false;
+
+  // columns by the names of the header
+  std::map<std::string, int> column;
+  {
+    std::istringstream ls(line);
+    std::string name;
+    for (int i = 0; std::getline(ls, name, ','); i++)
+      column[name] = i;
+  }
+  const char* needed[] = {"input", "preset", "stage", "switches", "seconds",
+    "peak_rss_kb"};
+  for (const char* name : needed)
+    if (column.find(name) == column.end())
+      return false;
+
+  while (std::getline(in, line))
+  {
+    std::vector<std::string> fields;
+    std::istringstream ls(line);
+    std::string field;
+    while (std::getline(ls, field, ','))
+      fields.push_back(field);
+    if ((int)fields.size() < (int)column.size())
+      continue;
+    auto& r = result_of(results, fields[column["input"]],
+        fields[column["preset"]], fields[column["stage"]]);
+    r.switches = fields[column["switches"]];
+    r.sec = std::atof(fields[column["seconds"]].c_str());
+    r.rss_kb = std::atol(fields[column["peak_rss_kb"]].c_str());
+  }
+  return true;
+}
+
+// Stages slower or bigger than the baseline run with the same switches by
+// more than tolerance, above the noise of 5 ms and 4 MB. n_compared gets the
+// number of stages found in the baseline.
+static int compare_results(const std::vector<bench_result>& results,
+    const std::vector<bench_result>& baseline, double tolerance,
+    int& n_compared)
+{
+  int n_regressions = 0;
+  n_compared = 0;
+  fmt::print("\n{:<24} {:<10} {:<26} {:>10} {:>10} {:>7} {:>10} {:>10} {:>7}\n",
+      "input", "preset", "stage", "base(s)", "now(s)", "ratio",
+      "base(MB)", "now(MB)", "ratio");
+  for (const auto& r : results)
+  {
+    const bench_result* b = nullptr;
+    for (const auto& x : baseline)
+      if (x.input == r.input && x.preset == r.preset && x.stage == r.stage &&
+          x.switches == r.switches)
+        b = &x;
+    if (b == nullptr)
+      continue;
+    n_compared++;
+    double t_ratio = b->sec > 0. ? r.sec / b->sec : 1.;
+    double m_ratio = b->rss_kb > 0 ? (double)r.rss_kb / b->rss_kb : 1.;
+    bool slower = t_ratio > 1. + tolerance && r.sec - b->sec > 0.005;
+    bool bigger = m_ratio > 1. + tolerance && r.rss_kb - b->rss_kb > 4096;
+    fmt::print("{:<24} {:<10} {:<26} {:>10.4f} {:>10.4f} {:>6.2f}x {:>10.1f}"
+        " {:>10.1f} {:>6.2f}x{}\n", r.input, r.preset, r.stage, b->sec, r.sec,
+        t_ratio, b->rss_kb / 1024., r.rss_kb / 1024., m_ratio,
+        slower || bigger ? "  REGRESSION" : "");
+    if (slower || bigger)
+      n_regressions++;
+  }
+  fmt::print("{:d} regressions in {:d} of {:d} stages found in the baseline.\n",
+      n_regressions, n_compared, (int)results.size());
+  return n_regressions;
+}
+
+static void print_usage()
+{
+  printf("Usage: tetgen_bench [-d data dir] [-n repeats] [-s scale]"
+      " [-o results.csv]\n"
+      "                    [-b baseline.csv] [-t tolerance] [-w work dir]\n"
+      "       tetgen_bench --self-test [-w work dir]\n");
+}
+
+// Record a baseline of a small sphere and read it back: compared with it,
+// the same results must match every stage without a regression, and after
+// one tetgen phase is made twice as slow, that phase must be the only one
+static int self_test(const std::string workdir)
+{
+  bench_input sphere;
+  sphere.name = "sphere";
+  make_sphere(2, sphere.V, sphere.F);
+  tetgenio in;
+  mesh_to_tetgenio(sphere.V, sphere.F, in);
+
+  std::vector<bench_result> results, baseline;
+  int n_failed = 0;
+  for (const auto& preset : presets_of(in, true, 0.01))
+    run_preset(results, sphere, in, preset, workdir, n_failed);
+  std::string file = workdir + "/tetgen_bench.selftest.csv";
+  bool ok = n_failed == 0 && write_results(file, results) &&
+    read_results(file, baseline);
+  std::remove(file.c_str());
+  if (!ok)
+  {
+    printf("Fail to record the baseline\n");
+    return 1;
+  }
+
+  int n_same, n_slow, n_compared, n_compared_slow;
+  n_same = compare_results(results, baseline, 0.2, n_compared);
+  auto slow = std::find_if(results.begin(), results.end(),
+      [](const bench_result& r) { return r.stage.compare(0, 7, "tetgen:") == 0; });
+  if (slow == results.end())
+  {
+    printf("No tetgen phase was timed\n");
+    return 1;
+  }
+  slow->sec = 2. * slow->sec + 0.01;
+  n_slow = compare_results(results, baseline, 0.2, n_compared_slow);
+
+  ok = n_compared == (int)results.size() && n_same == 0 &&
+    n_compared_slow == (int)results.size() && n_slow == 1;
+  fmt::print("\nself test {}: {:d} of {:d} stages compared, {:d} regressions"
+      " before and {:d} after slowing {} [-{}] down\n", ok ? "passed" : "FAILED",
+      n_compared, (int)results.size(), n_same, n_slow, slow->stage,
+      slow->switches);
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string datadir = TETGEN_BENCH_DATA;
+  std::string workdir = ".";
+  std::string output;
+  std::string baseline_file;
+  int repeats = 3;
+  double scale = 1.;
+  double tolerance = 0.2;
+  bool selftest = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "-d" && has_value)
+      datadir = argv[++i];
+    else if (arg == "-n" && has_value)
+      repeats = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "-s" && has_value)
+      scale = std::max(1e-3, std::atof(argv[++i]));
+    else if (arg == "-o" && has_value)
+      output = argv[++i];
+    else if (arg == "-b" && has_value)
+      baseline_file = argv[++i];
+    else if (arg == "-t" && has_value)
+      tolerance = std::atof(argv[++i]);
+    else if (arg == "-w" && has_value)
+      workdir = argv[++i];
+    else if (arg == "--self-test")
+      selftest = true;
+    else
+    {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (selftest)
+    return self_test(workdir);
+
+  std::vector<bench_result> baseline;
+  if (!baseline_file.empty() && !read_results(baseline_file, baseline))
+  {
+    printf("Fail to read baseline %s\n", baseline_file.c_str());
+    return 1;
+  }
+
+  std::vector<bench_input> inputs;
+  const char* files[] = {"bunny.off", "cylinder.ply", "finger.stl",
+    "couple_square.stl"};
+  for (const char* file : files)
+  {
+    inputs.push_back(bench_input());
+    inputs.back().name = file;
+    inputs.back().file = datadir + "/" + file;
+  }
+  {
+    bench_input sphere;
+    sphere.name = "sphere";
+    make_sphere(4, sphere.V, sphere.F);
+    inputs.push_back(sphere);
+
+    bench_input cloud;
+    cloud.name = fmt::format("points{:d}", (int)(200000 * scale));
+    make_point_cloud((int)(200000 * scale), cloud.V);
+    inputs.push_back(cloud);
+  }
+
+  fmt::print("Benchmarking {:d} inputs, best of {:d} runs.\n",
+      (int)inputs.size(), repeats);
+  std::vector<bench_result> results;
+  int n_failed = 0;
+  for (const auto& input : inputs)
+  {
+    std::vector<bench_preset> presets;
+    for (int rep = 0; rep < repeats; rep++)
+    {
+      tetgenio in;
+      bool ok;
+      if (!input.file.empty())
+      {
+        {
+          tetgenio io;
+          ok = measure(result_of(results, input.name, "", "load_tetgen"),
+              [&]() { return load_tetgen(input.file, io); });
+        }
+        ok = ok && measure(result_of(results, input.name, "", "load"),
+            [&]() { return read_tetgenio(input.file, in); });
+      }
+      else if (input.F.rows() > 0)
+        ok = mesh_to_tetgenio(input.V, input.F, in);
+      else
+        ok = points_to_tetgenio(input.V, in);
+      if (!ok)
+      {
+        fmt::print("{}: load failed\n", input.name);
+        n_failed++;
+        break;
+      }
+
+      if (presets.empty())
+        presets = presets_of(in, in.numberoffacets > 0, scale);
+      for (const auto& preset : presets)
+        run_preset(results, input, in, preset, workdir, n_failed);
+    }
+  }
+
+  fmt::print("\n{:<24} {:<10} {:<26} {:>10} {:>10} {:>12} {:>10}\n",
+      "input", "preset", "stage", "tets", "best(s)", "tets/s", "peak(MB)");
+  for (const auto& r : results)
+    fmt::print("{:<24} {:<10} {:<26} {:>10d} {:>10.4f} {:>12.0f} {:>10.1f}\n",
+        r.input, r.preset, r.stage, r.tets, r.sec,
+        r.tets > 0 ? r.tets / r.sec : 0., r.rss_kb / 1024.);
+
+  if (!output.empty() && !write_results(output, results))
+  {
+    printf("Fail to write %s\n", output.c_str());
+    n_failed++;
+  }
+
+  int n_regressions = 0, n_compared;
+  if (!baseline.empty())
+    n_regressions = compare_results(results, baseline, tolerance, n_compared);
+
+  return n_failed + n_regressions;
+}
@@ -0,0 +1,295 @@
+#include "tetgen_cache.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// switches that only matter once the constrained mesh is made
+static const char* late_letters = "qaOoefngkvzIJB";
+// switches that do not start from a plc, or need more than the input
+static const char* uncached_letters = "rmidcwRH";
+
+static bool is_argument(const std::string& s, size_t i)
+{
+  char c = s[i];
+  if ((c >= '0' && c <= '9') || c == '.' || c == '/' || c == ',' ||
+      c == '+' || c == '-')
+    return true;
+  // the exponent of a number, as in a1e-3, unlike the -e switch
+  if (c == 'e' && i > 0 && i + 1 < s.size())
+  {
+    char prev = s[i - 1], next = s[i + 1];
+    return ((prev >= '0' && prev <= '9') || prev == '.') &&
+        ((next >= '0' && next <= '9') || next == '+' || next == '-');
+  }
+  return false;
+}
+
+bool split_late_switches(const std::string switches, std::string& mesh,
+    std::string& late)
+{
+  mesh.clear();
+  late.clear();
+  bool plc = false, quality = false;
+  for (size_t i = 0; i < switches.size(); )
+  {
+    // a letter and its argument
+    size_t end = i + 1;
+    while (end < switches.size() && is_argument(switches, end))
+      end++;
+    char c = switches[i];
+    std::string sw = switches.substr(i, end - i);
+    i = end;
+
+    if (std::strchr(uncached_letters, c))
+      return false;
+    if (c == 'p')
+      plc = true;
+    if (c == 'q')
+      quality = true;
+    if (c == 'a')
+    {
+      // a bare -a takes the volume bounds of the regions
+      if (sw.size() == 1)
+        return false;
+      quality = true;
+    }
+    if (std::strchr(late_letters, c))
+      late += sw;
+    else
+      mesh += sw;
+  }
+  return plc && quality;
+}
+
+// 64 bit words mixed in turn, the tail of an array padded with zeros
+struct hasher
+{
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  void add(uint64_t w)
+  {
+    h = (h ^ w) * 0x100000001b3ull;
+    h ^= h >> 29;
+  }
+
+  void add(const void* data, size_t bytes)
+  {
+    add(bytes);
+    if (data == nullptr)
+      return;
+    const char* p = (const char*)data;
+    for (; bytes >= 8; p += 8, bytes -= 8)
+    {
+      uint64_t w;
+      std::memcpy(&w, p, 8);
+      add(w);
+    }
+    if (bytes > 0)
+    {
+      uint64_t w = 0;
+      std::memcpy(&w, p, bytes);
+      add(w);
+    }
+  }
+};
+
+uint64_t hash_tetgenio(const tetgenio& in)
+{
+  hasher h;
+  h.add(in.firstnumber);
+  h.add(in.pointlist, sizeof(REAL) * 3 * in.numberofpoints);
+  h.add(in.pointattributelist,
+      sizeof(REAL) * in.numberofpointattributes * in.numberofpoints);
+  h.add(in.pointmarkerlist, sizeof(int) * in.numberofpoints);
+
+  h.add(in.numberoffacets);
+  for (int i = 0; in.facetlist != NULL && i < in.numberoffacets; i++)
+  {
+    const tetgenio::facet& f = in.facetlist[i];
+    h.add(f.numberofpolygons);
+    for (int k = 0; k < f.numberofpolygons; k++)
+      h.add(f.polygonlist[k].vertexlist,
+          sizeof(int) * f.polygonlist[k].numberofvertices);
+    h.add(f.holelist, sizeof(REAL) * 3 * f.numberofholes);
+  }
+  h.add(in.facetmarkerlist, sizeof(int) * in.numberoffacets);
+  h.add(in.edgelist, sizeof(int) * 2 * in.numberofedges);
+  h.add(in.edgemarkerlist, sizeof(int) * in.numberofedges);
+
+  h.add(in.holelist, sizeof(REAL) * 3 * in.numberofholes);
+  h.add(in.regionlist, sizeof(REAL) * 5 * in.numberofregions);
+  h.add(in.facetconstraintlist, sizeof(REAL) * 2 * in.numberoffacetconstraints);
+  h.add(in.segmentconstraintlist,
+      sizeof(REAL) * 3 * in.numberofsegmentconstraints);
+  return h.h;
+}
+
+struct tetgen_cache::entry
+{
+  uint64_t key = 0;
+  std::string switches; // the mesh switches it was made with
+  double sec = 0.;      // time to make it
+  tetgenbehavior b;     // the behavior of mesh, which keeps a pointer to it
+  tetgenmesh mesh;
+};
+
+// Run a stage of tetgen, with the return codes of run_tetgen()
+template <class Stage>
+static int run_stage(Stage stage)
+{
+  using namespace std;
+  try
+  {
+    stage();
+  }
+  catch (int e)
+  {
+    if (e == 11)
+    {
+      cerr << "^" << __FUNCTION__ << ": Tetgen was cancelled" << endl;
+      return 3;
+    }
+    cerr << "^" << __FUNCTION__ << ": TETGEN CRASHED... KABOOOM!!!" << endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Make the constrained mesh of in, with all the switches of a run so that
+// tetgen is set up as by that run. Returns 0 on success, and fills stats
+// of a run that stopped.
+int tetgen_cache::make_entry(tetgenio* in, const std::string switches,
+    const std::string mesh_switches, uint64_t key, std::unique_ptr<entry>& e,
+    tetgenio::meshstats* stats)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  e.reset(new entry);
+  e->key = key;
+  e->switches = mesh_switches;
+  std::vector<char> cswitches(switches.begin(), switches.end());
+  cswitches.push_back('\0');
+  if (!e->b.parse_commandline(cswitches.data()))
+  {
+    e.reset();
+    return 1;
+  }
+
+  tetgenio out;
+  int info = run_stage([&]()
+  {
+    tetrahedralize_constrained(&e->b, in, &out, &e->mesh);
+  });
+  e->sec = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - t0).count();
+  if (info != 0)
+  {
+    if (stats)
+      *stats = out.stats;
+    e.reset();
+  }
+  return info;
+}
+
+tetgen_cache::tetgen_cache()
+{
+}
+
+tetgen_cache::~tetgen_cache()
+{
+  wait();
+}
+
+void tetgen_cache::wait()
+{
+  if (worker.joinable())
+    worker.join();
+}
+
+void tetgen_cache::clear()
+{
+  wait();
+  next.reset();
+}
+
+void tetgen_cache::prefetch(tetgenio* in, const std::string switches,
+    const std::string mesh_switches, uint64_t key)
+{
+  worker = std::thread([this, in, switches, mesh_switches, key]()
+  {
+    // made between the runs, without reporting progress
+    tetgenio::ProgressFunc progress = in->progressfunc;
+    in->progressfunc = NULL;
+    make_entry(in, switches, mesh_switches, key, next, nullptr);
+    in->progressfunc = progress;
+  });
+}
+
+int tetgen_cache::tetrahedralize(tetgenio* in, const std::string switches,
+    dMat& V, iMat& T, iVec& TR, tetgenio::meshstats* stats,
+    cache_report* report, int n_threads)
+{
+  wait();
+
+  cache_report r;
+  std::string mesh_switches, late_switches;
+  if (!split_late_switches(switches, mesh_switches, late_switches))
+  {
+    if (report)
+      *report = r;
+    return tetrahedralize_tetgenio(in, switches, V, T, TR, stats, n_threads);
+  }
+  r.used = true;
+  hasher h;
+  h.add(hash_tetgenio(*in));
+  h.add(mesh_switches.data(), mesh_switches.size());
+  uint64_t key = h.h;
+
+  std::unique_ptr<entry> e;
+  if (next && next->key == key && next->switches == mesh_switches)
+  {
+    e = std::move(next);
+    r.hit = true;
+    r.saved_sec = e->sec;
+  }
+  else
+  {
+    next.reset();
+    int info = make_entry(in, switches, mesh_switches, key, e, stats);
+    if (info != 0)
+    {
+      if (report)
+        *report = r;
+      return info;
+    }
+  }
+  if (report)
+    *report = r;
+
+  // the late switches of this run are taken into the behavior of the mesh
+  tetgenbehavior b;
+  std::vector<char> cswitches(switches.begin(), switches.end());
+  cswitches.push_back('\0');
+  b.parse_commandline(cswitches.data());
+  tetgenio out;
+  int info = run_stage([&]()
+  {
+    tetrahedralize_refine(&b, &out, &e->mesh);
+  });
+  e.reset();
+  if (stats)
+    *stats = out.stats;
+  if (info == 0 && out.numberoftetrahedra == 0)
+  {
+    std::cerr << "^" << __FUNCTION__ << ": Tetgen failed to create tets"
+        << std::endl;
+    info = 2;
+  }
+  if (info == 0)
+    info = convert_tetgenio(out, V, T, TR, n_threads);
+
+  // the mesh for the next run, once this one is done
+  prefetch(in, switches, mesh_switches, key);
+  return info;
+}
@@ -0,0 +1,72 @@
+#ifndef TETGEN_CACHE_H
+#define TETGEN_CACHE_H
+
+#include "tetgen_utils.h"
+
+#include <memory>
+#include <thread>
+
+// Split tetgen switches into the ones that make the constrained, carved mesh
+// and the late ones which only matter after it: the quality switches q, a#,
+// O and o, and the output switches e, f, n, g, k, v, z, I, J and B. Returns
+// false when the mesh can not be refined from a kept constrained mesh, i.e.
+// without -p, without q or a#, with a bare -a (volume bounds of the regions),
+// or with any of r, m, i, d, c, w, R and H.
+bool split_late_switches(const std::string switches, std::string& mesh,
+    std::string& late);
+
+// Hash of the points, facets, markers, holes, regions and constraints of a
+// tetgen input.
+uint64_t hash_tetgenio(const tetgenio& in);
+
+// How a run used the cache
+struct cache_report
+{
+  bool used = false;     // the switches allow refining a kept mesh
+  bool hit = false;      // the constrained mesh was ready
+  double saved_sec = 0.; // time of the constrained meshing a hit skipped
+};
+
+// The constrained, carved mesh of an input, kept as tetgen's own mesh so that
+// when only the late switches change it is refined in place (see
+// tetrahedralize_refine) instead of running the Delaunay tetrahedralization,
+// boundary recovery and hole carving again. It is keyed by a hash of the
+// input and of the switches which make it (see split_late_switches), and the
+// result is the same as tetgen's own run with all the switches.
+//
+// Refinement uses the mesh up, so after each run the next one is made on a
+// background thread from the same input and switches, ready for the next
+// run. The input is used by that thread until the next run or clear(), so it
+// must not be changed or freed before. The mesh holds about the memory of
+// the constrained mesh of the input.
+class tetgen_cache
+{
+public:
+  tetgen_cache();
+  ~tetgen_cache();
+
+  // As tetrahedralize_tetgenio(). Switches which can not be refined from a
+  // kept mesh are run as they are. If report is given, it receives whether
+  // the cache was used and hit.
+  int tetrahedralize(tetgenio* in, const std::string switches, dMat& V,
+      iMat& T, iVec& TR, tetgenio::meshstats* stats = nullptr,
+      cache_report* report = nullptr, int n_threads = 0);
+
+  // Drop the kept mesh, after the one being made is done.
+  void clear();
+
+private:
+  struct entry;
+
+  static int make_entry(tetgenio* in, const std::string switches,
+      const std::string mesh_switches, uint64_t key, std::unique_ptr<entry>& e,
+      tetgenio::meshstats* stats);
+  void prefetch(tetgenio* in, const std::string switches,
+      const std::string mesh_switches, uint64_t key);
+  void wait();
+
+  std::unique_ptr<entry> next; // the kept mesh, made by worker
+  std::thread worker;
+};
+
+#endif
@@ -1,44 +1,70 @@
-#include <igl/readOBJ.h>
-#include <igl/readOFF.h>
-#include <igl/readPLY.h>
-#include <igl/readSTL.h>
 #include <igl/remove_unreferenced.h>
-#include <igl/boundary_facets.h>
-#include <igl/copyleft/tetgen/mesh_to_tetgenio.h>
+#include <igl/slice_mask.h>
 #include <igl/copyleft/tetgen/tetgenio_to_tetmesh.h>
 #include <igl/opengl/glfw/Viewer.h>
 #include <igl/opengl/glfw/imgui/ImGuiMenu.h>
 #include <imgui/imgui.h>
 #include <tetgen/tetgen.h>
 #include <fmt/ostream.h>
+#include <atomic>
+#include <thread>
+#include "tetgen_utils.h"
+#include "tetgen_batch.h"
+#include "tetgen_reorder.h"
+#include "tetgen_cache.h"
 
 igl::opengl::glfw::Viewer viewer;
 
-typedef Eigen::MatrixXd dMat;
-typedef Eigen::MatrixXi iMat;
-typedef Eigen::VectorXi iVec;
-typedef Eigen::Matrix<bool, Eigen::Dynamic, 1> bVec;
-
 // input visualization & representation
 dMat V_ori;
 iMat F_ori;
 
 tetgenio tetio;
 
+// the constrained mesh of tetio, refined in place when only the quality
+// switches change
+tetgen_cache tet_cache;
+bool reuse_mesh = true;
+
 // output representation
-int t_offset = 0; // when input is stl, t_offset should be 1
 dMat V_tet;
 iMat T_tet;
 iMat F_tet;
 iVec TX_tet;
+region_faces faces_tet;
 
 // visualize representation
 bVec mask;
-bVec mask_prev;
-iMat T_vis;
-iMat TX_vis;
 iMat F_vis;
 
+// background tetrahedralization
+std::thread tet_worker;
+std::atomic<bool> tet_running(false);  // a job is in flight
+std::atomic<bool> tet_finished(false); // the job is done, results not taken
+std::atomic<bool> tet_cancel(false);   // ask tetgen to stop
+std::atomic<int> tet_phase(0);         // tetgenio::meshphase
+std::atomic<float> tet_fraction(0.f);  // fraction of phase, -1 if unknown
+int tet_info = 0;
+std::string tet_switches;
+dMat V_job;
+iMat T_job;
+iVec TX_job;
+region_faces faces_job;
+tetgenio::meshstats stats_job;
+cache_report cache_job;
+
+// statistics of the last run, the shown mesh unless it failed
+tetgenio::meshstats stats_tet;
+bool has_stats = false;
+int stats_info = 0; // tet_info of the run of stats_tet
+cache_report cache_tet;
+
+const char* phase_names[tetgenio::MESH_PHASES] = {
+  "Initialize", "Delaunay", "Surface mesh", "Boundary recovery",
+  "Carve holes", "Coarsening", "Delaunay recovery", "Refinement",
+  "Smoothing", "Improvement", "Output"
+};
+
 void show_origin()
 {
   viewer.data().clear();
@@ -50,163 +76,202 @@ void show_tet()
 {
   viewer.data().clear();
 
-  // update T_vis by mask
-  bVec mask_T(TX_tet.size());
-  for (int i = 0; i < TX_tet.size(); i++)
-    mask_T(i) = mask(TX_tet(i));
-  igl::slice_mask(T_tet, mask_T, 1, T_vis);
-  igl::slice_mask(TX_tet, mask_T, 1, TX_vis);
-
-  // show T_vis
-  igl::boundary_facets(T_vis, F_vis);
+  // boundary of the shown regions from the precomputed face groups
+  visible_faces(faces_tet, mask, F_vis);
   viewer.data().set_mesh(V_tet, F_vis);
 }
 
-bool load_tetgenio(const std::string filename)
+bool tet_progress(void*, int phase, REAL fraction)
 {
-  char* f_tmp = new char[filename.size() + 1];
-  std::strcpy(f_tmp, filename.c_str());
-
-  auto ends_with = [](const std::string long_str, const std::string suffix)
-  {
-    return long_str.substr(long_str.size() - suffix.size(), suffix.size()) == suffix;
-  };
-
-  bool tetgenio_info = false;
-  bool igl_info = false;
-
-  if (ends_with(filename, ".obj"))
-  {
-    igl_info = igl::readOBJ(filename, V_ori, F_ori);
-    if (igl_info)
-      tetgenio_info = igl::copyleft::tetgen::mesh_to_tetgenio(V_ori, F_ori, tetio);
-    t_offset = 0;
-  }
-
-  if (ends_with(filename, ".off"))
-  {
-    igl_info = igl::readOFF(filename, V_ori, F_ori);
-    tetgenio_info = tetio.load_off(f_tmp);
-    t_offset = 0;
-  }
-
-  if (ends_with(filename, ".ply"))
-  {
-    igl_info = igl::readPLY(filename, V_ori, F_ori);
-    tetgenio_info = tetio.load_ply(f_tmp);
-    t_offset = 0;
-  }
-    
-  if (ends_with(filename, ".stl"))
-  {
-    dMat N;
-    igl_info = igl::readSTL(filename, V_ori, F_ori, N);
-    tetgenio_info = tetio.load_stl(f_tmp);
-    t_offset = 1;
-  }
-
-  delete[] f_tmp;
+  tet_phase = phase;
+  tet_fraction = (float)fraction;
+  return !tet_cancel;
+}
 
-  if (igl_info)
+bool load_tetgenio(const std::string filename)
+{
+  // the kept mesh is of the old input, which is replaced
+  tet_cache.clear();
+
+  // parse once, the viewer and tetgen share the result
+  mesh_polygons polygons;
+  bool info = load_mesh(filename, V_ori, F_ori, &polygons) &&
+    mesh_to_tetgenio(V_ori, F_ori, tetio, &polygons);
+  // set here, tetio is not written while the cache makes the next mesh
+  tetio.progressfunc = tet_progress;
+  tetio.countpredicates = 1; // shown in the statistics window
+
+  if (info)
   {
     show_origin();
+    printf("Succeed to load file %s to tetgenio struct.\n", filename.c_str());
   }
   else {
     printf("Fail to load file %s as triangular mesh.\n", filename.c_str());
   }
 
-  if (tetgenio_info)
+  return info;
+}
+
+// run tetgen on tetio in a worker thread, results go to V_job/T_job/TX_job
+// and the region faces to faces_job
+void start_tetrahedralize(const std::string switches)
+{
+  if (tet_running)
+    return;
+
+  tet_cancel = false;
+  tet_finished = false;
+  tet_phase = tetgenio::MESH_INIT;
+  tet_fraction = 0.f;
+  tet_running = true;
+  tet_switches = switches;
+
+  bool use_cache = reuse_mesh;
+  tet_worker = std::thread([switches, use_cache]()
   {
-    printf("Succeed to load file %s to tetgenio struct.\n", filename.c_str());
-  }
-  else {
-    printf("Fail to load file %s to tetgenio struct\n", filename.c_str());
-  }
+    cache_job = cache_report();
+    if (use_cache)
+      tet_info = tet_cache.tetrahedralize(&tetio, switches,
+          V_job, T_job, TX_job, &stats_job, &cache_job);
+    else
+    {
+      tet_cache.clear();
+      tet_info = tetrahedralize_tetgenio(&tetio, switches,
+          V_job, T_job, TX_job, &stats_job);
+    }
+    if (tet_info == 0)
+      build_region_faces(T_job, TX_job, faces_job);
+    tet_finished = true;
+  });
 
-  return tetgenio_info;
+  // keep drawing frames so that the progress bar is updated
+  viewer.core().is_animating = true;
 }
 
-int tetrahedralize_tetgenio(tetgenio* in, std::string switches, dMat& V, iMat& T, iVec& TR)
+// called from the render loop, swap in the results of a finished job
+bool finish_tetrahedralize()
 {
-  tetgenio out;
-  using namespace std;
-  try
-  {
-    char * cswitches = new char[switches.size() + 1];
-    std::strcpy(cswitches, switches.c_str());
-    ::tetrahedralize(cswitches, in, &out);
-    delete[] cswitches;
-  }
-  catch (int e)
-  {
-    cerr << "^" << __FUNCTION__ << ": TETGEN CRASHED... KABOOOM!!!" << endl;
-    return 1;
-  }
-  if (out.numberoftetrahedra == 0)
-  {
-    cerr << "^" << __FUNCTION__ << ": Tetgen failed to create tets" << endl;
-    return 2;
-  }
+  if (!tet_finished)
+    return false;
 
-  // readout vertices
-  if(out.pointlist == NULL)
+  tet_worker.join();
+  tet_finished = false;
+  tet_running = false;
+  viewer.core().is_animating = false;
+
+  // the stats of a failed or cancelled run show how far it got
+  stats_tet = stats_job;
+  stats_info = tet_info;
+  cache_tet = cache_job;
+  has_stats = true;
+  if (cache_tet.hit)
+    printf("Refined the kept constrained mesh, %.3f seconds saved.\n",
+        cache_tet.saved_sec);
+  if (tet_info != 0)
   {
-    printf("^tetgenio_to_tetmesh Error: point list is NULL\n");
+    printf("Fail to tetrahedralize mesh with argv [-%s]\n", tet_switches.c_str());
     return false;
   }
-  V.resize(out.numberofpoints, 3);
-  for (int i = 0; i < out.numberofpoints; i++)
-  {
-    V(i, 0) = out.pointlist[i*3+0];
-    V(i, 1) = out.pointlist[i*3+1];
-    V(i, 2) = out.pointlist[i*3+2];
-  }
 
-  // readout tetrahedras
-  if(out.tetrahedronlist == NULL)
+  V_tet.swap(V_job);
+  T_tet.swap(T_job);
+  TX_tet.swap(TX_job);
+  std::swap(faces_tet, faces_job);
+  return true;
+}
+
+// timing and counters of the last run, next to the control panel
+void draw_stats_window()
+{
+  if (!has_stats)
+    return;
+
+  const tetgenio::meshstats& st = stats_tet;
+  ImGui::SetNextWindowPos(ImVec2(200, 30), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(300, 400), ImGuiCond_FirstUseEver);
+  ImGui::Begin(
+      "Tetgen Statistics", nullptr,
+      ImGuiWindowFlags_NoSavedSettings
+  );
+  if (stats_info == 3)
+    ImGui::Text("Cancelled, counted up to the stop.");
+  else if (stats_info != 0)
+    ImGui::Text("Failed, counted up to the stop.");
+
+  if (ImGui::CollapsingHeader("Time", ImGuiTreeNodeFlags_DefaultOpen))
   {
-    printf("^tetgenio_to_tetmesh Error: tet list is NULL\n");
-    return false;
+    ImGui::Columns(3, "phases", false);
+    ImGui::Text("phase"); ImGui::NextColumn();
+    ImGui::Text("wall s"); ImGui::NextColumn();
+    ImGui::Text("cpu s"); ImGui::NextColumn();
+    double wall = 0., cpu = 0.;
+    for (int i = 0; i < tetgenio::MESH_PHASES; i++)
+    {
+      wall += st.walltime[i];
+      cpu += st.cputime[i];
+      // phases the switches skipped
+      if (st.walltime[i] == 0. && st.cputime[i] == 0.)
+        continue;
+      // phases of the constrained mesh, made before the run on a hit
+      if (cache_tet.hit && i < tetgenio::MESH_COARSEN)
+        ImGui::Text("%s *", phase_names[i]);
+      else
+        ImGui::Text("%s", phase_names[i]);
+      ImGui::NextColumn();
+      ImGui::Text("%.3f", st.walltime[i]); ImGui::NextColumn();
+      ImGui::Text("%.3f", st.cputime[i]); ImGui::NextColumn();
+    }
+    ImGui::Text("Total"); ImGui::NextColumn();
+    ImGui::Text("%.3f", wall); ImGui::NextColumn();
+    ImGui::Text("%.3f", cpu); ImGui::NextColumn();
+    ImGui::Columns(1);
+    if (cache_tet.hit)
+      ImGui::Text("Constrained mesh reused, %.3f s saved (* made ahead)",
+          cache_tet.saved_sec);
+    else if (cache_tet.used)
+      ImGui::Text("Constrained mesh made, kept for the next run");
   }
-  assert(out.numberofcorners == 4);
-  T.resize(out.numberoftetrahedra, 4);
-  for (int i = 0; i < out.numberoftetrahedra; i++)
+
+  if (ImGui::CollapsingHeader("Predicates", ImGuiTreeNodeFlags_DefaultOpen))
   {
-    T(i, 0) = out.tetrahedronlist[i*4+0];
-    T(i, 1) = out.tetrahedronlist[i*4+1];
-    T(i, 2) = out.tetrahedronlist[i*4+2];
-    T(i, 3) = out.tetrahedronlist[i*4+3];
+    const char* names[3] = {"orient3d", "insphere", "orient4d"};
+    const long calls[3] = {st.orient3dcount, st.inspherecount, st.orient4dcount};
+    const long exact[3] = {st.orient3dexact, st.insphereexact, st.orient4dexact};
+    ImGui::Columns(3, "predicates", false);
+    ImGui::Text("predicate"); ImGui::NextColumn();
+    ImGui::Text("calls"); ImGui::NextColumn();
+    ImGui::Text("exact"); ImGui::NextColumn();
+    for (int i = 0; i < 3; i++)
+    {
+      ImGui::Text("%s", names[i]); ImGui::NextColumn();
+      ImGui::Text("%ld", calls[i]); ImGui::NextColumn();
+      ImGui::Text("%ld (%.2f%%)", exact[i],
+          calls[i] > 0 ? 100. * exact[i] / calls[i] : 0.); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
   }
 
-  T.array() -= min(t_offset, T.minCoeff());
-  assert(T.maxCoeff() >= 0);
-  assert(T.minCoeff() >= 0);
-  assert(T.maxCoeff() < V.rows());
-
-  // readout tetrahedra attributes
-  if(out.tetrahedronattributelist == NULL)
+  if (ImGui::CollapsingHeader("Flips", ImGuiTreeNodeFlags_DefaultOpen))
   {
-    printf("^tetgenio_to_tetmesh Error: tet attr list is NULL\n");
-    return false;
+    ImGui::Text("1-4 %ld, 2-6 %ld, n-2n %ld",
+        st.flip14count, st.flip26count, st.flipn2ncount);
+    ImGui::Text("2-3 %ld, 3-2 %ld, 4-4 %ld",
+        st.flip23count, st.flip32count, st.flip44count);
+    ImGui::Text("4-1 %ld, 3-1 %ld, 2-2 %ld",
+        st.flip41count, st.flip31count, st.flip22count);
   }
-  TR.resize(out.numberoftetrahedra, 1);
-  unordered_map<double, int> hashUniqueRegions;
-  hashUniqueRegions.clear();
-  int nR = 0;
-  for (int i = 0; i < out.numberoftetrahedra; i++)
+
+  if (ImGui::CollapsingHeader("Mesh", ImGuiTreeNodeFlags_DefaultOpen))
   {
-    double attr = out.tetrahedronattributelist[i]; 
-    if (hashUniqueRegions.find(attr) == hashUniqueRegions.end())
-    {
-      hashUniqueRegions[attr] = nR++;
-    }
-    TR(i, 0) = hashUniqueRegions[attr];
+    ImGui::Text("point locations %ld, %.1f tets walked", st.locatecount,
+        st.locatecount > 0 ? (double)st.locatesteps / st.locatecount : 0.);
+    ImGui::Text("Steiner points: %ld segment, %ld facet, %ld volume",
+        st.steinersegcount, st.steinerfaccount, st.steinervolcount);
+    ImGui::Text("peak pool memory %.1f MB", st.peakmemory / 1048576.);
   }
-  assert(hashUniqueRegions.size() == nR);
-  assert(TR.minCoeff() >= 0);
-  assert(TR.maxCoeff() < nR);
-  
-  return 0;
+
+  ImGui::End();
 }
 
 bool show_mesh_vertex(int vid)
@@ -221,12 +286,21 @@ bool show_mesh_vertex(int vid)
 
 bool remove_unrefed = true;
 bool export_tet_info = true;
+int export_order = 0; // mesh_order of the exported vertices
 bool export_file(const std::string filename)
 {
   iMat T_exp;
   dMat V_exp;
-  iMat TX_exp=TX_vis;
-	
+
+  // tets of the shown regions
+  bVec mask_T(TX_tet.size());
+  for (int i = 0; i < TX_tet.size(); i++)
+    mask_T(i) = mask(TX_tet(i));
+  iMat T_vis;
+  iVec TX_exp;
+  igl::slice_mask(T_tet, mask_T, 1, T_vis);
+  igl::slice_mask(TX_tet, mask_T, 1, TX_exp);
+
   if (remove_unrefed)
   {
     printf("Remove unreferenced vertices.\n");
@@ -242,37 +316,31 @@ bool export_file(const std::string filename)
     V_exp = V_tet;
   }
 
-  printf("Writing as VTX format.\n");
-  auto out = std::ofstream(filename, std::ofstream::out | std::ofstream::trunc);
-  
-  fmt::print(out, "# writing with .vtx format\n");
-
-  // tetrahedron information number, which is its cluster info
-  if (export_tet_info)
-    fmt::print(out, "txn 1\n");
-
-  for (int i = 0; i < V_exp.rows(); i++)
-    fmt::print(out, "v {:f} {:f} {:f}\n", V_exp(i, 0), V_exp(i, 1), V_exp(i, 2));
-
-  if (export_tet_info)
-  {
-    for (int i = 0; i < T_exp.rows(); i++)
-      fmt::print(out, "t {:d} {:d} {:d} {:d} {:d}\n",
-          T_exp(i, 0), T_exp(i, 1), T_exp(i, 2), T_exp(i, 3), TX_exp(i));
-  }
-  else
+  if (export_order != (int)mesh_order::none)
   {
-    for (int i = 0; i < T_exp.rows(); i++)
-      fmt::print(out, "t {:d} {:d} {:d} {:d}\n",
-          T_exp(i, 0), T_exp(i, 1), T_exp(i, 2), T_exp(i, 3));
+    mesh_order order = (mesh_order)export_order;
+    mesh_locality before = measure_locality(T_exp);
+    reorder_tet_mesh(order, V_exp, T_exp, TX_exp);
+    mesh_locality after = measure_locality(T_exp);
+    printf("Reorder vertices by %s: bandwidth %d -> %d, edge span %.1f -> %.1f,"
+        " tet span %.1f -> %.1f, tet stride %.1f -> %.1f\n",
+        mesh_order_name(order), before.bandwidth, after.bandwidth,
+        before.edge_span, after.edge_span, before.tet_span, after.tet_span,
+        before.tet_stride, after.tet_stride);
   }
-	
-  out.close();
-  return true;
+
+  // .vtxb for the binary format, .vtx otherwise
+  printf("Writing %s.\n", filename.c_str());
+  return write_tet_mesh(filename, V_exp, T_exp, TX_exp, export_tet_info);
 }
 
 int main(int argc, char* argv[])
 {
+  if (argc >= 2 && std::string(argv[1]) == "--batch")
+    return run_batch(argc - 2, argv + 2);
+  if (argc >= 2 && std::string(argv[1]) == "--bench-load")
+    return run_bench_load(argc - 2, argv + 2);
+
   std::string input_file;
   if (argc == 2)
     input_file = std::string(argv[1]);
@@ -286,6 +354,16 @@ int main(int argc, char* argv[])
 
   menu.callback_draw_custom_window = [&]()
   {
+    // pick up the result of a finished background job
+    if (finish_tetrahedralize())
+    {
+      mask = bVec::Ones(TX_tet.maxCoeff() + 1);
+      visible_faces(faces_tet, mask, F_tet);
+
+      printf("Tetrahedralize finished.\n");
+      show_tet();
+    }
+
     // Define next window position + size
     ImGui::SetNextWindowPos(ImVec2(0, 30), ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowSize(ImVec2(200, 400), ImGuiCond_FirstUseEver);
@@ -299,7 +377,7 @@ int main(int argc, char* argv[])
     {
       // TODO file dialog
       ImGui::InputText("input file", input_file);
-      if (ImGui::Button("Open", ImVec2(-1,0)))
+      if (ImGui::Button("Open", ImVec2(-1,0)) && !tet_running)
       {
         load_tetgenio(input_file);
         // TODO error handle
@@ -312,33 +390,25 @@ int main(int argc, char* argv[])
       // tetrahedralizaiton argument 
       static std::string para_str = "pqAa1e-1";
       ImGui::InputText("parameters", para_str);
+      ImGui::Checkbox("reuse constrained mesh", &reuse_mesh);
       // TODO help menu
       // tetrahedralize
-      if (ImGui::Button("Tetrahedralize", ImVec2(-1,0)))
+      if (!tet_running)
       {
-        int info;
-        info = tetrahedralize_tetgenio(&tetio, para_str, V_tet, T_tet, TX_tet);
-        if (info != 0)
-        {
-          printf("Fail to tetrahedralize mesh with argv [-%s]\n", para_str.c_str());
-          return;
-        }
-
-        // switch tet to make it outward
-        {
-          Eigen::VectorXi l = T_tet.col(0);
-          T_tet.col(0) = T_tet.col(1);
-          T_tet.col(1) = l;
-        }
-        
-        igl::boundary_facets(T_tet, F_tet);
-
-        mask = bVec::Ones(TX_tet.maxCoeff() + 1);
-        mask_prev = mask;
+        if (ImGui::Button("Tetrahedralize", ImVec2(-1,0)))
+          start_tetrahedralize(para_str);
+      }
+      else
+      {
+        float fraction = tet_fraction;
+        std::string overlay = phase_names[tet_phase];
+        if (fraction < 0.f)
+          fraction = 0.f;
+        ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay.c_str());
+        if (ImGui::Button(tet_cancel ? "Cancelling..." : "Cancel", ImVec2(-1,0)))
+          tet_cancel = true;
+      }
 
-        printf("Tetrahedralize finished.\n");
-        show_tet();
-       }
     }
 
     // Debug
@@ -358,19 +428,16 @@ int main(int argc, char* argv[])
     // Visualize
     if (ImGui::CollapsingHeader("Show Region", ImGuiTreeNodeFlags_DefaultOpen))
     {
+      // redraw once however many regions changed in this frame
+      bool mask_changed = false;
       for (int i = 0; i < mask.size(); i++)
       {
         std::string label = fmt::format("Show region {:d}", i);
-        ImGui::Checkbox(label.c_str(), &mask(i));
-      }
-      for (int i = 0; i < mask.size(); i++)
-      {
-        if (mask(i) != mask_prev(i))
-        {
-          mask_prev(i) = mask(i);
-          show_tet();
-        }
+        if (ImGui::Checkbox(label.c_str(), &mask(i)))
+          mask_changed = true;
       }
+      if (mask_changed)
+        show_tet();
     }
 
     // Export
@@ -379,6 +446,7 @@ int main(int argc, char* argv[])
       // Export options
       ImGui::Checkbox("remove unreferred", &remove_unrefed);
       ImGui::Checkbox("export region info", &export_tet_info);
+      ImGui::Combo("vertex order", &export_order, "tetgen\0hilbert\0rcm\0");
       // TODO file dialog
       static std::string output_file = "test.vtx";
       ImGui::InputText("output file", output_file);
@@ -392,6 +460,8 @@ int main(int argc, char* argv[])
     }
 
     ImGui::End();
+
+    draw_stats_window();
   };
 
   tetgenbehavior b;
@@ -399,5 +469,10 @@ int main(int argc, char* argv[])
 
   viewer.launch();
 
+  // stop a job still running when the window is closed
+  tet_cancel = true;
+  if (tet_worker.joinable())
+    tet_worker.join();
+
   return 0;
 }
@@ -0,0 +1,300 @@
+#include "tetgen_reorder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+bool parse_mesh_order(const std::string name, mesh_order& order)
+{
+  if (name == "none")
+    order = mesh_order::none;
+  else if (name == "hilbert")
+    order = mesh_order::hilbert;
+  else if (name == "rcm")
+    order = mesh_order::rcm;
+  else
+    return false;
+  return true;
+}
+
+const char* mesh_order_name(mesh_order order)
+{
+  switch (order)
+  {
+  case mesh_order::hilbert:
+    return "hilbert";
+  case mesh_order::rcm:
+    return "rcm";
+  default:
+    return "none";
+  }
+}
+
+// the 6 edges of a tet
+static const int tet_edges[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+
+mesh_locality measure_locality(const iMat& T)
+{
+  mesh_locality m;
+  if (T.rows() == 0)
+    return m;
+
+  double edge_sum = 0., span_sum = 0., stride_sum = 0.;
+  int prev_min = 0;
+  for (int i = 0; i < T.rows(); i++)
+  {
+    for (const auto& e : tet_edges)
+    {
+      int d = std::abs(T(i, e[0]) - T(i, e[1]));
+      m.bandwidth = std::max(m.bandwidth, d);
+      edge_sum += d;
+    }
+    int lo = T.row(i).minCoeff();
+    span_sum += T.row(i).maxCoeff() - lo;
+    if (i > 0)
+      stride_sum += std::abs(lo - prev_min);
+    prev_min = lo;
+  }
+  // edges shared by several tets are counted once per tet
+  m.edge_span = edge_sum / (6. * T.rows());
+  m.tet_span = span_sum / T.rows();
+  m.tet_stride = T.rows() > 1 ? stride_sum / (T.rows() - 1) : 0.;
+  return m;
+}
+
+// Index of a point on the 3d Hilbert curve of the given order, by Skilling's
+// transform of the axes to the transposed index, interleaved into one key
+static uint64_t hilbert_key(uint32_t x[3], int bits)
+{
+  const uint32_t m = 1u << (bits - 1);
+  for (uint32_t q = m; q > 1; q >>= 1)
+  {
+    uint32_t p = q - 1;
+    for (int i = 0; i < 3; i++)
+    {
+      if (x[i] & q)
+        x[0] ^= p;
+      else
+      {
+        uint32_t t = (x[0] ^ x[i]) & p;
+        x[0] ^= t;
+        x[i] ^= t;
+      }
+    }
+  }
+  for (int i = 1; i < 3; i++)
+    x[i] ^= x[i - 1];
+  uint32_t t = 0;
+  for (uint32_t q = m; q > 1; q >>= 1)
+    if (x[2] & q)
+      t ^= q - 1;
+  for (int i = 0; i < 3; i++)
+    x[i] ^= t;
+
+  uint64_t key = 0;
+  for (int b = bits - 1; b >= 0; b--)
+    for (int i = 0; i < 3; i++)
+      key = (key << 1) | ((x[i] >> b) & 1);
+  return key;
+}
+
+static void hilbert_order(const dMat& V, std::vector<int>& order)
+{
+  const int bits = 21; // 3 * 21 bits fit in the key
+  const double cells = (double)((1u << bits) - 1);
+  Eigen::RowVector3d lo = V.colwise().minCoeff();
+  double extent = (V.colwise().maxCoeff() - lo).maxCoeff();
+  double scale = extent > 0. ? cells / extent : 0.;
+
+  std::vector<uint64_t> keys(V.rows());
+  for (int i = 0; i < V.rows(); i++)
+  {
+    uint32_t x[3];
+    for (int k = 0; k < 3; k++)
+      x[k] = (uint32_t)std::min(cells, (V(i, k) - lo(k)) * scale);
+    keys[i] = hilbert_key(x, bits);
+  }
+  order.resize(V.rows());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+      [&](int a, int b) { return keys[a] < keys[b]; });
+}
+
+// Vertex adjacency over the tet edges, in compressed rows sorted by id
+static void edge_graph(int n, const iMat& T, std::vector<int>& start,
+    std::vector<int>& adj)
+{
+  start.assign(n + 1, 0);
+  for (int i = 0; i < T.rows(); i++)
+    for (const auto& e : tet_edges)
+    {
+      start[T(i, e[0]) + 1]++;
+      start[T(i, e[1]) + 1]++;
+    }
+  std::partial_sum(start.begin(), start.end(), start.begin());
+  std::vector<int> fill(start.begin(), start.end() - 1);
+  adj.resize(start[n]);
+  for (int i = 0; i < T.rows(); i++)
+    for (const auto& e : tet_edges)
+    {
+      int a = T(i, e[0]), b = T(i, e[1]);
+      adj[fill[a]++] = b;
+      adj[fill[b]++] = a;
+    }
+
+  // drop the edges repeated by the tets around them
+  int out = 0;
+  for (int v = 0; v < n; v++)
+  {
+    int begin = start[v], end = start[v + 1];
+    std::sort(adj.begin() + begin, adj.begin() + end);
+    start[v] = out;
+    for (int j = begin; j < end; j++)
+      if (j == begin || adj[j] != adj[j - 1])
+        adj[out++] = adj[j];
+  }
+  start[n] = out;
+  adj.resize(out);
+}
+
+static void rcm_order(int n, const iMat& T, std::vector<int>& order)
+{
+  std::vector<int> start, adj;
+  edge_graph(n, T, start, adj);
+  auto degree = [&](int v) { return start[v + 1] - start[v]; };
+
+  // breadth first levels from root, over the unvisited vertices; returns
+  // the depth and leaves the last level at the end of queue
+  std::vector<int> stamp(n, -1), queue;
+  int bfs_count = 0;
+  std::vector<char> visited(n, 0);
+  auto bfs = [&](int root, int& last_begin)
+  {
+    int id = bfs_count++;
+    queue.clear();
+    queue.push_back(root);
+    stamp[root] = id;
+    int depth = 0, level_begin = 0;
+    while (level_begin < (int)queue.size())
+    {
+      int level_end = queue.size();
+      last_begin = level_begin;
+      for (int q = level_begin; q < level_end; q++)
+        for (int j = start[queue[q]]; j < start[queue[q] + 1]; j++)
+        {
+          int w = adj[j];
+          if (!visited[w] && stamp[w] != id)
+          {
+            stamp[w] = id;
+            queue.push_back(w);
+          }
+        }
+      level_begin = level_end;
+      depth++;
+    }
+    return depth;
+  };
+
+  std::vector<int> by_degree(n);
+  std::iota(by_degree.begin(), by_degree.end(), 0);
+  std::stable_sort(by_degree.begin(), by_degree.end(),
+      [&](int a, int b) { return degree(a) < degree(b); });
+
+  order.clear();
+  order.reserve(n);
+  std::vector<int> nbrs;
+  for (int seed : by_degree)
+  {
+    if (visited[seed])
+      continue;
+
+    // pseudo-peripheral root: move to the smallest degree vertex of the
+    // last level while that makes the component deeper
+    int root = seed, last_begin = 0;
+    int depth = bfs(root, last_begin);
+    for (int iter = 0; iter < 8; iter++)
+    {
+      int next = queue[last_begin];
+      for (int q = last_begin; q < (int)queue.size(); q++)
+        if (degree(queue[q]) < degree(next))
+          next = queue[q];
+      int next_begin = 0;
+      int next_depth = bfs(next, next_begin);
+      if (next_depth <= depth)
+        break;
+      root = next;
+      depth = next_depth;
+      last_begin = next_begin;
+    }
+
+    // Cuthill-McKee from root, neighbours by increasing degree
+    size_t head = order.size();
+    order.push_back(root);
+    visited[root] = 1;
+    while (head < order.size())
+    {
+      int v = order[head++];
+      nbrs.clear();
+      for (int j = start[v]; j < start[v + 1]; j++)
+        if (!visited[adj[j]])
+        {
+          visited[adj[j]] = 1;
+          nbrs.push_back(adj[j]);
+        }
+      std::stable_sort(nbrs.begin(), nbrs.end(),
+          [&](int a, int b) { return degree(a) < degree(b); });
+      order.insert(order.end(), nbrs.begin(), nbrs.end());
+    }
+  }
+  std::reverse(order.begin(), order.end());
+}
+
+void reorder_tet_mesh(mesh_order order, dMat& V, iMat& T, iVec& TX)
+{
+  if (order == mesh_order::none || V.rows() == 0)
+    return;
+
+  // vorder[k] is the vertex numbered k
+  std::vector<int> vorder;
+  if (order == mesh_order::hilbert)
+    hilbert_order(V, vorder);
+  else
+    rcm_order(V.rows(), T, vorder);
+
+  std::vector<int> new_id(V.rows());
+  dMat V_new(V.rows(), 3);
+  for (int k = 0; k < V.rows(); k++)
+  {
+    new_id[vorder[k]] = k;
+    V_new.row(k) = V.row(vorder[k]);
+  }
+  V.swap(V_new);
+
+  // tets by their sorted new vertex ids
+  std::vector<std::array<int, 4>> keys(T.rows());
+  for (int i = 0; i < T.rows(); i++)
+  {
+    for (int k = 0; k < 4; k++)
+      keys[i][k] = T(i, k) = new_id[T(i, k)];
+    std::sort(keys[i].begin(), keys[i].end());
+  }
+  std::vector<int> torder(T.rows());
+  std::iota(torder.begin(), torder.end(), 0);
+  std::stable_sort(torder.begin(), torder.end(),
+      [&](int a, int b) { return keys[a] < keys[b]; });
+
+  iMat T_new(T.rows(), T.cols());
+  iVec TX_new(TX.size());
+  for (int i = 0; i < T.rows(); i++)
+  {
+    T_new.row(i) = T.row(torder[i]);
+    if (TX.size() == T.rows())
+      TX_new(i) = TX(torder[i]);
+  }
+  T.swap(T_new);
+  if (TX.size() == T.rows())
+    TX.swap(TX_new);
+}
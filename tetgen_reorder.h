@@ -0,0 +1,38 @@
+#ifndef TETGEN_REORDER_H
+#define TETGEN_REORDER_H
+
+#include "tetgen_utils.h"
+
+// Vertex orders for the exported tet mesh. tetgen numbers the vertices and
+// tets as they lie in its memory pools, which after refinement scatters the
+// neighbours of a vertex over the whole mesh.
+enum class mesh_order
+{
+  none,    // as tetgen returns them
+  hilbert, // vertices along a Hilbert curve through the bounding box
+  rcm      // vertices by reverse Cuthill-McKee over the tet edges
+};
+
+// Parse "none", "hilbert" or "rcm".
+bool parse_mesh_order(const std::string name, mesh_order& order);
+const char* mesh_order_name(mesh_order order);
+
+// How far apart the vertex ids of neighbouring elements are
+struct mesh_locality
+{
+  int bandwidth = 0;       // largest id difference over the tet edges
+  double edge_span = 0.;   // mean id difference over the tet edges
+  double tet_span = 0.;    // mean difference of the largest and smallest
+                           // vertex id of a tet
+  double tet_stride = 0.;  // mean difference of the smallest vertex id of
+                           // consecutive tets
+};
+
+mesh_locality measure_locality(const iMat& T);
+
+// Renumber the vertices of a tet mesh in the given order, then sort the tets
+// by their new vertex ids. The vertex order within a tet is kept, so are the
+// orientations; TX follows the tets.
+void reorder_tet_mesh(mesh_order order, dMat& V, iMat& T, iVec& TX);
+
+#endif
@@ -0,0 +1,1102 @@
+#include "tetgen_utils.h"
+
+#include <igl/readOBJ.h>
+#include <fmt/ostream.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only view of a whole file, memory mapped where the platform allows
+class mapped_file
+{
+public:
+  mapped_file(const std::string filename)
+  {
+#ifdef _WIN32
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open())
+      return;
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    begin = buffer.data();
+    length = buffer.size();
+    opened = true;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+      length = st.st_size;
+      opened = true;
+      if (length > 0)
+      {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+          opened = false;
+        else
+        {
+          begin = (const char*)p;
+          madvise(p, length, MADV_SEQUENTIAL);
+        }
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~mapped_file()
+  {
+#ifndef _WIN32
+    if (begin != nullptr)
+      munmap((void*)begin, length);
+#endif
+  }
+
+  bool is_open() const { return opened; }
+  const char* data() const { return begin; }
+  const char* end() const { return begin + length; }
+  size_t size() const { return length; }
+
+private:
+  const char* begin = nullptr;
+  size_t length = 0;
+  bool opened = false;
+#ifdef _WIN32
+  std::vector<char> buffer;
+#endif
+};
+
+// Tokenizer over a text buffer; '#' starts a comment until the end of line
+struct text_cursor
+{
+  const char* p;
+  const char* end;
+
+  void skip_space()
+  {
+    while (p < end)
+    {
+      if (*p == '#')
+        while (p < end && *p != '\n')
+          p++;
+      else if (std::isspace((unsigned char)*p))
+        p++;
+      else
+        break;
+    }
+  }
+
+  void skip_line()
+  {
+    while (p < end && *p != '\n')
+      p++;
+  }
+
+  bool at_line_end()
+  {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+    return p >= end || *p == '\n' || *p == '#';
+  }
+
+  std::string token()
+  {
+    skip_space();
+    const char* t = p;
+    while (p < end && !std::isspace((unsigned char)*p))
+      p++;
+    return std::string(t, p);
+  }
+
+  template <typename T>
+  bool number(T& x)
+  {
+    skip_space();
+    if (p < end && *p == '+')
+      p++;
+    auto r = std::from_chars(p, end, x);
+    if (r.ec != std::errc())
+      return false;
+    p = r.ptr;
+    return true;
+  }
+};
+
+// The faces of a mesh, as fans of triangles for the viewer and, once one of
+// them is not a triangle, as polygons for tetgen
+struct face_list
+{
+  std::vector<int> faces;
+  mesh_polygons* polygons = nullptr;
+  bool polygonal = false;
+
+  void add(const int* poly, int n)
+  {
+    if (n < 3)
+      return;
+    if (polygons && (polygonal || n != 3))
+    {
+      if (!polygonal)
+      {
+        // the faces so far were triangles
+        polygonal = true;
+        polygons->P = faces;
+        polygons->start.resize(faces.size() / 3 + 1);
+        for (size_t i = 0; i < polygons->start.size(); i++)
+          polygons->start[i] = 3 * (int)i;
+      }
+      polygons->P.insert(polygons->P.end(), poly, poly + n);
+      polygons->start.push_back((int)polygons->P.size());
+    }
+    for (int k = 1; k + 1 < n; k++)
+    {
+      faces.push_back(poly[0]);
+      faces.push_back(poly[k]);
+      faces.push_back(poly[k + 1]);
+    }
+  }
+};
+
+static void to_matrices(const std::vector<double>& verts,
+    const std::vector<int>& faces, dMat& V, iMat& F)
+{
+  V = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>>(
+      verts.data(), verts.size() / 3, 3);
+  F = Eigen::Map<const Eigen::Matrix<int, Eigen::Dynamic, 3, Eigen::RowMajor>>(
+      faces.data(), faces.size() / 3, 3);
+}
+
+static bool parse_off(const mapped_file& file, dMat& V, iMat& F,
+    mesh_polygons* polygons)
+{
+  text_cursor c{file.data(), file.end()};
+  std::string magic = c.token();
+  if (magic != "OFF" && magic != "COFF" && magic != "NOFF")
+    return false;
+
+  int nv = 0, nf = 0, ne = 0;
+  if (!c.number(nv) || !c.number(nf) || !c.number(ne) || nv < 0 || nf < 0)
+    return false;
+
+  // each number takes a digit and a separator, so a vertex needs at least
+  // six bytes and a face of three or more vertices at least eight
+  size_t left = (size_t)(c.end - c.p) + 1;
+  if ((size_t)nv > left / 6 || (size_t)nf > left / 8)
+    return false;
+
+  std::vector<double> verts(3 * (size_t)nv);
+  for (int i = 0; i < nv; i++)
+  {
+    // colors or normals may follow on the same line
+    if (!c.number(verts[3*i]) || !c.number(verts[3*i+1]) || !c.number(verts[3*i+2]))
+      return false;
+    c.skip_line();
+  }
+
+  face_list faces;
+  faces.polygons = polygons;
+  faces.faces.reserve(3 * (size_t)nf);
+  std::vector<int> poly;
+  for (int i = 0; i < nf; i++)
+  {
+    int n = 0;
+    if (!c.number(n) || n < 3 || (size_t)n > (size_t)(c.end - c.p + 1) / 2)
+      return false;
+    poly.resize(n);
+    for (int k = 0; k < n; k++)
+      if (!c.number(poly[k]) || poly[k] < 0 || poly[k] >= nv)
+        return false;
+    c.skip_line();
+    faces.add(poly.data(), n);
+  }
+
+  to_matrices(verts, faces.faces, V, F);
+  return true;
+}
+
+// Weld exactly coincident vertices, as stl stores every corner of every facet
+struct vertex_welder
+{
+  struct key_hash
+  {
+    size_t operator()(const std::array<double, 3>& k) const
+    {
+      uint64_t h = 0;
+      for (double x : k)
+      {
+        // -0.0 == 0.0, so both must hash the same
+        x += 0.0;
+        uint64_t b;
+        std::memcpy(&b, &x, sizeof(b));
+        h = (h ^ b) * 0x9E3779B97F4A7C15ull;
+      }
+      return (size_t)(h ^ (h >> 32));
+    }
+  };
+
+  std::unordered_map<std::array<double, 3>, int, key_hash> index;
+  std::vector<double> verts;
+
+  explicit vertex_welder(size_t n_corners)
+  {
+    index.reserve(n_corners / 2);
+    verts.reserve(n_corners / 2 * 3);
+  }
+
+  int add(double x, double y, double z)
+  {
+    auto it = index.emplace(std::array<double, 3>{{x, y, z}}, (int)(verts.size() / 3));
+    if (it.second)
+    {
+      verts.push_back(x);
+      verts.push_back(y);
+      verts.push_back(z);
+    }
+    return it.first->second;
+  }
+};
+
+static bool parse_stl(const mapped_file& file, dMat& V, iMat& F)
+{
+  const char* data = file.data();
+  size_t size = file.size();
+
+  // binary stl has an 80 bytes header, a count and 50 bytes per facet
+  bool binary = false;
+  uint32_t nf = 0;
+  if (size >= 84)
+  {
+    std::memcpy(&nf, data + 80, sizeof(nf));
+    binary = (size == 84 + 50 * (size_t)nf);
+  }
+  if (!binary && (size < 5 || std::strncmp(data, "solid", 5) != 0))
+    binary = size >= 84 && size >= 84 + 50 * (size_t)nf;
+
+  std::vector<int> faces;
+  if (binary)
+  {
+    vertex_welder welder(3 * (size_t)nf);
+    faces.reserve(3 * (size_t)nf);
+    const char* p = data + 84;
+    for (uint32_t i = 0; i < nf; i++, p += 50)
+    {
+      float xyz[9];
+      std::memcpy(xyz, p + 12, sizeof(xyz)); // skip the normal
+      for (int k = 0; k < 3; k++)
+        faces.push_back(welder.add(xyz[3*k], xyz[3*k+1], xyz[3*k+2]));
+    }
+    to_matrices(welder.verts, faces, V, F);
+    return true;
+  }
+
+  vertex_welder welder(size / 64);
+  text_cursor c{data, file.end()};
+  while (c.p < c.end)
+  {
+    std::string t = c.token();
+    if (t != "vertex")
+      continue;
+    double x, y, z;
+    if (!c.number(x) || !c.number(y) || !c.number(z))
+      return false;
+    faces.push_back(welder.add(x, y, z));
+  }
+  if (faces.size() % 3 != 0)
+    return false;
+  to_matrices(welder.verts, faces, V, F);
+  return true;
+}
+
+// A scalar or list property of a ply element
+struct ply_property
+{
+  std::string name;
+  std::string type;       // value type
+  std::string count_type; // empty unless this is a list
+};
+
+struct ply_element
+{
+  std::string name;
+  size_t count = 0;
+  std::vector<ply_property> properties;
+};
+
+static int ply_type_size(const std::string& type)
+{
+  if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+    return 1;
+  if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+    return 2;
+  if (type == "int" || type == "uint" || type == "int32" || type == "uint32" ||
+      type == "float" || type == "float32")
+    return 4;
+  if (type == "double" || type == "float64")
+    return 8;
+  return 0;
+}
+
+// Read one binary ply value of the given type as double
+static double ply_binary_value(const char*& p, const std::string& type, bool swap)
+{
+  int size = ply_type_size(type);
+  unsigned char b[8];
+  std::memcpy(b, p, size);
+  if (swap)
+    std::reverse(b, b + size);
+  p += size;
+
+  if (type == "char" || type == "int8") { int8_t v; std::memcpy(&v, b, 1); return v; }
+  if (type == "uchar" || type == "uint8") { uint8_t v; std::memcpy(&v, b, 1); return v; }
+  if (type == "short" || type == "int16") { int16_t v; std::memcpy(&v, b, 2); return v; }
+  if (type == "ushort" || type == "uint16") { uint16_t v; std::memcpy(&v, b, 2); return v; }
+  if (type == "int" || type == "int32") { int32_t v; std::memcpy(&v, b, 4); return v; }
+  if (type == "uint" || type == "uint32") { uint32_t v; std::memcpy(&v, b, 4); return v; }
+  if (type == "float" || type == "float32") { float v; std::memcpy(&v, b, 4); return v; }
+  double v;
+  std::memcpy(&v, b, 8);
+  return v;
+}
+
+static bool parse_ply(const mapped_file& file, dMat& V, iMat& F,
+    mesh_polygons* polygons)
+{
+  text_cursor c{file.data(), file.end()};
+  if (c.token() != "ply")
+    return false;
+
+  // header
+  std::string format;
+  std::vector<ply_element> elements;
+  while (true)
+  {
+    std::string t = c.token();
+    if (t.empty())
+      return false;
+    if (t == "end_header")
+    {
+      c.skip_line();
+      c.p++;
+      break;
+    }
+    if (t == "format")
+      format = c.token(), c.skip_line();
+    else if (t == "element")
+    {
+      ply_element e;
+      e.name = c.token();
+      if (!c.number(e.count))
+        return false;
+      elements.push_back(e);
+    }
+    else if (t == "property" && !elements.empty())
+    {
+      ply_property prop;
+      prop.type = c.token();
+      if (prop.type == "list")
+      {
+        prop.count_type = c.token();
+        prop.type = c.token();
+      }
+      prop.name = c.token();
+      if (ply_type_size(prop.type) == 0 ||
+          (!prop.count_type.empty() && ply_type_size(prop.count_type) == 0))
+        return false;
+      elements.back().properties.push_back(prop);
+    }
+    else
+      c.skip_line(); // comment, obj_info
+  }
+
+  bool ascii = format == "ascii";
+  bool swap = format == "binary_big_endian";
+  if (!ascii && !swap && format != "binary_little_endian")
+    return false;
+
+  std::vector<double> verts;
+  face_list faces;
+  faces.polygons = polygons;
+  std::vector<int> poly;
+  const char* p = c.p;
+  for (const auto& e : elements)
+  {
+    bool is_vertex = e.name == "vertex";
+    bool is_face = e.name == "face";
+    int xyz[3] = {-1, -1, -1};
+    for (int k = 0; k < (int)e.properties.size(); k++)
+    {
+      const auto& name = e.properties[k].name;
+      if (name == "x") xyz[0] = k;
+      if (name == "y") xyz[1] = k;
+      if (name == "z") xyz[2] = k;
+    }
+    if (is_vertex)
+    {
+      if (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0)
+        return false;
+      if (e.count > file.size() / 3)
+        return false;
+      verts.resize(3 * e.count);
+    }
+
+    for (size_t i = 0; i < e.count; i++)
+    {
+      for (int k = 0; k < (int)e.properties.size(); k++)
+      {
+        const auto& prop = e.properties[k];
+        if (!prop.count_type.empty())
+        {
+          double n;
+          if (ascii ? !c.number(n) : p + ply_type_size(prop.count_type) > c.end)
+            return false;
+          if (!ascii)
+            n = ply_binary_value(p, prop.count_type, swap);
+          if (!(n >= 0 && n <= (double)(c.end - c.p)))
+            return false;
+          poly.resize((size_t)n);
+          for (size_t j = 0; j < poly.size(); j++)
+          {
+            double v;
+            if (ascii ? !c.number(v) : p + ply_type_size(prop.type) > c.end)
+              return false;
+            if (!ascii)
+              v = ply_binary_value(p, prop.type, swap);
+            poly[j] = (int)v;
+          }
+          if (is_face && (prop.name == "vertex_indices" || prop.name == "vertex_index"))
+            faces.add(poly.data(), (int)poly.size());
+          continue;
+        }
+
+        double v;
+        if (ascii ? !c.number(v) : p + ply_type_size(prop.type) > c.end)
+          return false;
+        if (!ascii)
+          v = ply_binary_value(p, prop.type, swap);
+        for (int d = 0; d < 3; d++)
+          if (is_vertex && xyz[d] == k)
+            verts[3*i+d] = v;
+      }
+    }
+  }
+
+  size_t nv = verts.size() / 3;
+  // the polygons use the same vertices as their triangles
+  for (int f : faces.faces)
+    if (f < 0 || (size_t)f >= nv)
+      return false;
+  to_matrices(verts, faces.faces, V, F);
+  return true;
+}
+
+bool load_mesh(const std::string filename, dMat& V, iMat& F,
+    mesh_polygons* polygons)
+{
+  auto ends_with = [](const std::string long_str, const std::string suffix)
+  {
+    return long_str.size() >= suffix.size() &&
+      long_str.substr(long_str.size() - suffix.size(), suffix.size()) == suffix;
+  };
+
+  if (ends_with(filename, ".obj"))
+    return igl::readOBJ(filename, V, F);
+
+  mapped_file file(filename);
+  if (!file.is_open())
+    return false;
+
+  if (ends_with(filename, ".off"))
+    return parse_off(file, V, F, polygons);
+  if (ends_with(filename, ".ply"))
+    return parse_ply(file, V, F, polygons);
+  if (ends_with(filename, ".stl"))
+    return parse_stl(file, V, F);
+  return false;
+}
+
+bool mesh_to_tetgenio(const dMat& V, const iMat& F, tetgenio& io,
+    const mesh_polygons* polygons)
+{
+  if (V.cols() != 3 || F.cols() != 3)
+    return false;
+
+  io.clean_memory();
+  io.initialize();
+  io.firstnumber = 0;
+
+  io.numberofpoints = V.rows();
+  io.pointlist = new REAL[V.size()];
+  Eigen::Map<Eigen::Matrix<REAL, Eigen::Dynamic, 3, Eigen::RowMajor>>(
+      io.pointlist, V.rows(), 3) = V;
+
+  // each polygon is one facet, as tetgenio::load_off and load_ply make them
+  if (polygons && !polygons->P.empty())
+  {
+    const int n_facets = (int)polygons->start.size() - 1;
+    io.numberoffacets = n_facets;
+    io.facetlist = new tetgenio::facet[n_facets];
+    for (int i = 0; i < n_facets; i++)
+    {
+      const int* poly = polygons->P.data() + polygons->start[i];
+      const int n = polygons->start[i + 1] - polygons->start[i];
+      tetgenio::facet& f = io.facetlist[i];
+      tetgenio::init(&f);
+      f.numberofpolygons = 1;
+      f.polygonlist = new tetgenio::polygon[1];
+      f.polygonlist[0].numberofvertices = n;
+      f.polygonlist[0].vertexlist = new int[n];
+      std::copy(poly, poly + n, f.polygonlist[0].vertexlist);
+    }
+    return true;
+  }
+
+  io.numberoffacets = F.rows();
+  io.facetlist = new tetgenio::facet[F.rows()];
+  for (int i = 0; i < F.rows(); i++)
+  {
+    tetgenio::facet& f = io.facetlist[i];
+    tetgenio::init(&f);
+    f.numberofpolygons = 1;
+    f.polygonlist = new tetgenio::polygon[1];
+    f.polygonlist[0].numberofvertices = 3;
+    f.polygonlist[0].vertexlist = new int[3] {F(i, 0), F(i, 1), F(i, 2)};
+  }
+  return true;
+}
+
+bool read_tetgenio(const std::string filename, tetgenio& io)
+{
+  dMat V;
+  iMat F;
+  mesh_polygons polygons;
+  return load_mesh(filename, V, F, &polygons) &&
+    mesh_to_tetgenio(V, F, io, &polygons);
+}
+
+// The number of threads to use for n_threads, all cores for 0
+static int thread_count(int n_threads)
+{
+  return n_threads > 0 ? n_threads :
+    std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Run f(begin, end, chunk) over [0, n) split in chunks, one thread each
+template <typename Func>
+static void parallel_chunks(int n, int n_chunks, Func f)
+{
+  std::vector<std::thread> workers;
+  for (int c = 1; c < n_chunks; c++)
+    workers.emplace_back(f, (int)((int64_t)n * c / n_chunks),
+        (int)((int64_t)n * (c + 1) / n_chunks), c);
+  f(0, (int)((int64_t)n / n_chunks), 0);
+  for (auto& w : workers)
+    w.join();
+}
+
+// Region attribute values in the order they are first met, with a cache of
+// the last hit since tets of one region tend to come in runs
+struct region_values
+{
+  std::vector<double> values;
+  std::unordered_map<double, int> index;
+  double last = 0.;
+  int last_id = -1;
+
+  int find(double x) const
+  {
+    if (values.size() <= 16)
+    {
+      for (size_t i = 0; i < values.size(); i++)
+        if (values[i] == x)
+          return (int)i;
+      return -1;
+    }
+    auto it = index.find(x);
+    return it == index.end() ? -1 : it->second;
+  }
+
+  int add(double x)
+  {
+    if (last_id >= 0 && last == x)
+      return last_id;
+    int id = find(x);
+    if (id < 0)
+    {
+      id = (int)values.size();
+      values.push_back(x);
+      if (values.size() == 17)
+        for (int i = 0; i < 17; i++)
+          index[values[i]] = i;
+      else if (values.size() > 17)
+        index[x] = id;
+    }
+    last = x;
+    last_id = id;
+    return id;
+  }
+};
+
+int run_tetgen(tetgenio* in, std::string switches, tetgenio& out)
+{
+  using namespace std;
+  try
+  {
+    std::vector<char> cswitches(switches.begin(), switches.end());
+    cswitches.push_back('\0');
+    ::tetrahedralize(cswitches.data(), in, &out);
+  }
+  catch (int e)
+  {
+    if (e == 11)
+    {
+      cerr << "^" << __FUNCTION__ << ": Tetgen was cancelled" << endl;
+      return 3;
+    }
+    cerr << "^" << __FUNCTION__ << ": TETGEN CRASHED... KABOOOM!!!" << endl;
+    return 1;
+  }
+  if (out.numberoftetrahedra == 0)
+  {
+    cerr << "^" << __FUNCTION__ << ": Tetgen failed to create tets" << endl;
+    return 2;
+  }
+  return 0;
+}
+
+int tetrahedralize_tetgenio(tetgenio* in, std::string switches,
+    dMat& V, iMat& T, iVec& TR, tetgenio::meshstats* stats, int n_threads)
+{
+  tetgenio out;
+  int info = run_tetgen(in, switches, out);
+  if (stats)
+    *stats = out.stats;
+  if (info != 0)
+    return info;
+  return convert_tetgenio(out, V, T, TR, n_threads);
+}
+
+int convert_tetgenio(tetgenio& out, dMat& V, iMat& T, iVec& TR, int n_threads)
+{
+  // readout vertices, and release tetgen's copy right away
+  if(out.pointlist == NULL)
+  {
+    printf("^tetgenio_to_tetmesh Error: point list is NULL\n");
+    return 2;
+  }
+  V = Eigen::Map<const Eigen::Matrix<REAL, Eigen::Dynamic, 3, Eigen::RowMajor>>(
+      out.pointlist, out.numberofpoints, 3);
+  delete[] out.pointlist;
+  out.pointlist = NULL;
+
+  // readout tetrahedras
+  if(out.tetrahedronlist == NULL)
+  {
+    printf("^tetgenio_to_tetmesh Error: tet list is NULL\n");
+    return 2;
+  }
+  assert(out.numberofcorners == 4);
+  const int n_tets = out.numberoftetrahedra;
+  const int* tets = out.tetrahedronlist;
+  const REAL* attrs = out.tetrahedronattributelist;
+  const int stride = out.numberoftetrahedronattributes;
+  const int offset = out.firstnumber;
+  T.resize(n_tets, 4);
+  TR.resize(n_tets, 1);
+
+  int n_chunks = std::max(1, std::min(thread_count(n_threads), n_tets / 65536));
+
+  // regions are numbered in the order they are first met, so each chunk
+  // first lists its own values, then the lists are merged in chunk order
+  region_values regions;
+  if (attrs != NULL)
+  {
+    std::vector<region_values> chunk_regions(n_chunks);
+    parallel_chunks(n_tets, n_chunks, [&](int begin, int end, int c)
+    {
+      for (int i = begin; i < end; i++)
+        chunk_regions[c].add(attrs[(size_t)i * stride]);
+    });
+    for (const auto& cr : chunk_regions)
+      for (double x : cr.values)
+        regions.add(x);
+  }
+
+  // one pass to copy the tets, switch them to make them outward, shift
+  // their numbering to 0 and compact their regions
+  parallel_chunks(n_tets, n_chunks, [&](int begin, int end, int)
+  {
+    region_values cache = regions;
+    for (int i = begin; i < end; i++)
+    {
+      const int* t = tets + (size_t)i * 4;
+      T(i, 0) = t[1] - offset;
+      T(i, 1) = t[0] - offset;
+      T(i, 2) = t[2] - offset;
+      T(i, 3) = t[3] - offset;
+      TR(i) = attrs == NULL ? 0 : cache.add(attrs[(size_t)i * stride]);
+    }
+  });
+  assert(T.minCoeff() >= 0);
+  assert(T.maxCoeff() < V.rows());
+
+  // release tetgen's copy of the tets as well
+  delete[] out.tetrahedronlist;
+  out.tetrahedronlist = NULL;
+  delete[] out.tetrahedronattributelist;
+  out.tetrahedronattributelist = NULL;
+
+  return 0;
+}
+
+void build_region_faces(const iMat& T, const iVec& TX, region_faces& faces)
+{
+  // faces of tet t, in the order of igl::boundary_facets
+  static const int corners[4][3] = {{1, 3, 2}, {0, 2, 3}, {0, 3, 1}, {0, 1, 2}};
+  struct tet_face
+  {
+    std::array<int, 3> key; // sorted vertices
+    int id;                 // 4 * tet + face
+  };
+
+  std::vector<tet_face> all(4 * (size_t)T.rows());
+  for (int t = 0; t < T.rows(); t++)
+  {
+    for (int k = 0; k < 4; k++)
+    {
+      auto& f = all[4 * (size_t)t + k];
+      f.key = {T(t, corners[k][0]), T(t, corners[k][1]), T(t, corners[k][2])};
+      std::sort(f.key.begin(), f.key.end());
+      f.id = 4 * t + k;
+    }
+  }
+  std::sort(all.begin(), all.end(), [](const tet_face& a, const tet_face& b)
+  {
+    return a.key < b.key;
+  });
+
+  // a face seen once is on the mesh boundary, a face seen twice is between
+  // two tets and kept from both sides when their regions differ
+  std::vector<std::array<int, 3>> kept; // (region, other region, face id)
+  for (size_t i = 0, j; i < all.size(); i = j)
+  {
+    for (j = i + 1; j < all.size() && all[j].key == all[i].key; j++);
+    if (j - i == 1)
+      kept.push_back({TX(all[i].id / 4), -1, all[i].id});
+    else if (j - i == 2)
+    {
+      int r0 = TX(all[i].id / 4), r1 = TX(all[i + 1].id / 4);
+      if (r0 != r1)
+      {
+        kept.push_back({r0, r1, all[i].id});
+        kept.push_back({r1, r0, all[i + 1].id});
+      }
+    }
+  }
+
+  // sort by region pair, only the pairs that occur become groups
+  std::sort(kept.begin(), kept.end());
+
+  int n_groups = 0;
+  for (size_t i = 0; i < kept.size(); i++)
+    n_groups += i == 0 || kept[i][0] != kept[i - 1][0] || kept[i][1] != kept[i - 1][1];
+
+  faces.F.resize(kept.size(), 3);
+  faces.groups.resize(n_groups, 4);
+  for (int i = 0, g = -1; i < (int)kept.size(); i++)
+  {
+    if (i == 0 || kept[i][0] != kept[i - 1][0] || kept[i][1] != kept[i - 1][1])
+      faces.groups.row(++g) << kept[i][0], kept[i][1], i, 0;
+    faces.groups(g, 3)++;
+    int t = kept[i][2] / 4, c = kept[i][2] % 4;
+    for (int d = 0; d < 3; d++)
+      faces.F(i, d) = T(t, corners[c][d]);
+  }
+}
+
+void visible_faces(const region_faces& faces, const bVec& mask, iMat& F)
+{
+  auto shown = [&](int g)
+  {
+    int region = faces.groups(g, 0), other = faces.groups(g, 1);
+    return region < mask.size() && mask(region) &&
+      (other < 0 || other >= mask.size() || !mask(other));
+  };
+
+  int n = 0;
+  for (int g = 0; g < faces.groups.rows(); g++)
+    if (shown(g))
+      n += faces.groups(g, 3);
+
+  F.resize(n, 3);
+  for (int g = 0, row = 0; g < faces.groups.rows(); g++)
+  {
+    if (!shown(g))
+      continue;
+    F.middleRows(row, faces.groups(g, 3)) =
+      faces.F.middleRows(faces.groups(g, 2), faces.groups(g, 3));
+    row += faces.groups(g, 3);
+  }
+}
+
+// Format rows [0, n) into out, chunks of rows on worker threads started
+// once. Chunks are written in order by the calling thread as they are done,
+// and a worker waits before running more than two chunks per thread ahead of
+// the writer so the buffers stay small
+template <typename Format>
+static void write_rows_parallel(std::ofstream& out, int n, int max_threads,
+    Format format)
+{
+  const int chunk_rows = 65536;
+  int n_chunks = (n + chunk_rows - 1) / chunk_rows;
+  int n_threads = std::max(1, std::min(thread_count(max_threads), n_chunks));
+  if (n_threads == 1)
+  {
+    fmt::memory_buffer buf;
+    for (int i = 0; i < n; i++)
+    {
+      format(buf, i);
+      if ((i + 1) % chunk_rows == 0 || i + 1 == n)
+      {
+        out.write(buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+    return;
+  }
+
+  const int n_slots = 2 * n_threads;
+  std::vector<fmt::memory_buffer> buffers(n_slots);
+  std::vector<int> done(n_slots, -1); // chunk held by each slot
+  int next = 0, written = 0;
+  std::mutex m;
+  std::condition_variable cv;
+
+  auto work = [&]()
+  {
+    while (true)
+    {
+      int k;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return next == n_chunks || next < written + n_slots; });
+        if (next == n_chunks)
+          return;
+        k = next++;
+      }
+      auto& buf = buffers[k % n_slots];
+      buf.clear();
+      for (int i = k * chunk_rows; i < std::min(n, (k + 1) * chunk_rows); i++)
+        format(buf, i);
+      {
+        std::lock_guard<std::mutex> lock(m);
+        done[k % n_slots] = k;
+      }
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int c = 0; c < n_threads; c++)
+    workers.emplace_back(work);
+
+  for (int k = 0; k < n_chunks; k++)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [&] { return done[k % n_slots] == k; });
+    }
+    const auto& buf = buffers[k % n_slots];
+    out.write(buf.data(), buf.size());
+    {
+      std::lock_guard<std::mutex> lock(m);
+      written = k + 1;
+    }
+    cv.notify_all();
+  }
+  for (auto& w : workers)
+    w.join();
+}
+
+bool write_vtx(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info, int n_threads)
+{
+  auto out = std::ofstream(filename, std::ofstream::out | std::ofstream::trunc);
+  if (!out.is_open())
+    return false;
+
+  fmt::print(out, "# writing with .vtx format\n");
+
+  // tetrahedron information number, which is its cluster info
+  if (export_tet_info)
+    fmt::print(out, "txn 1\n");
+
+  write_rows_parallel(out, V.rows(), n_threads, [&](fmt::memory_buffer& buf, int i)
+  {
+    fmt::format_to(buf, "v {:f} {:f} {:f}\n", V(i, 0), V(i, 1), V(i, 2));
+  });
+
+  if (export_tet_info)
+  {
+    write_rows_parallel(out, T.rows(), n_threads, [&](fmt::memory_buffer& buf, int i)
+    {
+      fmt::format_to(buf, "t {:d} {:d} {:d} {:d} {:d}\n",
+          T(i, 0), T(i, 1), T(i, 2), T(i, 3), TX(i));
+    });
+  }
+  else
+  {
+    write_rows_parallel(out, T.rows(), n_threads, [&](fmt::memory_buffer& buf, int i)
+    {
+      fmt::format_to(buf, "t {:d} {:d} {:d} {:d}\n",
+          T(i, 0), T(i, 1), T(i, 2), T(i, 3));
+    });
+  }
+
+  out.close();
+  return !out.fail();
+}
+
+static const uint64_t vtxb_align = 64;
+
+static uint64_t align_up(uint64_t x)
+{
+  return (x + vtxb_align - 1) / vtxb_align * vtxb_align;
+}
+
+bool write_vtxb(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info)
+{
+  auto out = std::ofstream(filename,
+      std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+  if (!out.is_open())
+    return false;
+
+  vtxb_header h;
+  std::memcpy(h.magic, "VTXB", 4);
+  h.version = 1;
+  h.txn = export_tet_info ? 1 : 0;
+  h.reserved = 0;
+  h.n_vertices = V.rows();
+  h.n_tets = T.rows();
+  h.vertex_offset = align_up(sizeof(vtxb_header));
+  h.tet_offset = align_up(h.vertex_offset + h.n_vertices * 3 * sizeof(double));
+  const char zeros[vtxb_align] = {};
+  uint64_t pos = 0;
+  auto pad_to = [&](uint64_t offset)
+  {
+    out.write(zeros, offset - pos);
+    pos = offset;
+  };
+  out.write((const char*)&h, sizeof(h));
+  pos = sizeof(h);
+
+  // rows are transposed into a buffer in blocks, to write large sequential
+  // pieces without a full row-major copy of the mesh
+  const int block_rows = 65536;
+  pad_to(h.vertex_offset);
+  std::vector<double> vbuf;
+  for (int begin = 0; begin < V.rows(); begin += block_rows)
+  {
+    int end = std::min<int>(V.rows(), begin + block_rows);
+    vbuf.resize((size_t)(end - begin) * 3);
+    for (int i = begin; i < end; i++)
+      for (int k = 0; k < 3; k++)
+        vbuf[(size_t)(i - begin) * 3 + k] = V(i, k);
+    out.write((const char*)vbuf.data(), vbuf.size() * sizeof(double));
+  }
+  pos += h.n_vertices * 3 * sizeof(double);
+
+  pad_to(h.tet_offset);
+  const int cols = 4 + h.txn;
+  std::vector<int32_t> tbuf;
+  for (int begin = 0; begin < T.rows(); begin += block_rows)
+  {
+    int end = std::min<int>(T.rows(), begin + block_rows);
+    tbuf.resize((size_t)(end - begin) * cols);
+    for (int i = begin; i < end; i++)
+    {
+      int32_t* row = tbuf.data() + (size_t)(i - begin) * cols;
+      for (int k = 0; k < 4; k++)
+        row[k] = T(i, k);
+      if (h.txn > 0)
+        row[4] = TX(i);
+    }
+    out.write((const char*)tbuf.data(), tbuf.size() * sizeof(int32_t));
+  }
+
+  out.close();
+  return !out.fail();
+}
+
+bool write_tet_mesh(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info, int n_threads)
+{
+  size_t dot = filename.find_last_of('.');
+  if (dot != std::string::npos && filename.substr(dot + 1) == "vtxb")
+    return write_vtxb(filename, V, T, TX, export_tet_info);
+  return write_vtx(filename, V, T, TX, export_tet_info, n_threads);
+}
+
+bool vtxb_view::open(const std::string filename)
+{
+  auto f = std::make_shared<const mapped_file>(filename);
+  if (!f->is_open() || f->size() < sizeof(vtxb_header))
+    return false;
+
+  vtxb_header h;
+  std::memcpy(&h, f->data(), sizeof(h));
+  if (std::memcmp(h.magic, "VTXB", 4) != 0 || h.version != 1)
+  {
+    std::cerr << filename << " is not a .vtxb file" << std::endl;
+    return false;
+  }
+  const uint64_t cols = 4 + (uint64_t)h.txn;
+  // compare counts with the room left after each offset, which cannot wrap
+  if (h.vertex_offset % vtxb_align != 0 || h.tet_offset % vtxb_align != 0 ||
+      h.vertex_offset > f->size() || h.tet_offset > f->size() ||
+      h.n_vertices > (f->size() - h.vertex_offset) / (3 * sizeof(double)) ||
+      h.n_tets > (f->size() - h.tet_offset) / (cols * sizeof(int32_t)))
+  {
+    std::cerr << filename << " is truncated" << std::endl;
+    return false;
+  }
+
+  file = f;
+  txn = h.txn;
+  new (&V) vertex_map((const double*)(f->data() + h.vertex_offset),
+      h.n_vertices, 3);
+  new (&T) tet_map((const int32_t*)(f->data() + h.tet_offset),
+      h.n_tets, cols);
+  return true;
+}
+
+bool read_vtxb(const std::string filename, dMat& V, iMat& T, iVec& TX)
+{
+  vtxb_view view;
+  if (!view.open(filename))
+    return false;
+  V = view.V;
+  T = view.T.leftCols(4);
+  if (view.txn > 0)
+    TX = view.T.col(4);
+  else
+    TX.setZero(T.rows());
+  return true;
+}
@@ -0,0 +1,141 @@
+#ifndef TETGEN_UTILS_H
+#define TETGEN_UTILS_H
+
+#include <Eigen/Core>
+#include <tetgen/tetgen.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef Eigen::MatrixXd dMat;
+typedef Eigen::MatrixXi iMat;
+typedef Eigen::VectorXi iVec;
+typedef Eigen::Matrix<bool, Eigen::Dynamic, 1> bVec;
+
+// The faces of a mesh as they were loaded: face i has the vertices
+// P[start[i]], ..., P[start[i + 1] - 1]. Empty when all faces are triangles.
+struct mesh_polygons
+{
+  std::vector<int> start;
+  std::vector<int> P;
+};
+
+// Load a triangle mesh (obj/off/ply/stl). off, ply and stl files are memory
+// mapped and parsed in one pass, polygons are split into triangles and the
+// coincident corners of stl facets are welded into shared vertices. If
+// polygons is given, it receives the unsplit faces of off and ply files.
+bool load_mesh(const std::string filename, dMat& V, iMat& F,
+    mesh_polygons* polygons = nullptr);
+
+// Fill io with the points and facets of a mesh, numbered from 0: a facet per
+// polygon if polygons is given and not empty, else per triangle of F.
+bool mesh_to_tetgenio(const dMat& V, const iMat& F, tetgenio& io,
+    const mesh_polygons* polygons = nullptr);
+
+// Load a triangle mesh (obj/off/ply/stl) into a tetgenio struct.
+bool read_tetgenio(const std::string filename, tetgenio& io);
+
+// Tetrahedralize in with tetgen switches. V, T and TR receive the vertices,
+// the tets (oriented so that the facet (x, y, z) faces outside) and the
+// region id of each tet, numbered from 0 in the order they first appear.
+// The tets are converted in one pass on n_threads threads (all cores for 0).
+// tetgen's point list is released before the tets are converted and its tet
+// lists right after, so only the tets are held twice, during the pass. If
+// stats is given, it receives the timing and counters of the run, up to where
+// it stopped if tetgen failed or was cancelled. Returns 0 on success.
+int tetrahedralize_tetgenio(tetgenio* in, std::string switches,
+    dMat& V, iMat& T, iVec& TR, tetgenio::meshstats* stats = nullptr,
+    int n_threads = 0);
+
+// Run tetgen with switches on in, into out. Returns 0 on success, 1 if
+// tetgen failed, 2 if it made no tets and 3 if it was cancelled.
+int run_tetgen(tetgenio* in, std::string switches, tetgenio& out);
+
+// The conversion done by tetrahedralize_tetgenio() from tetgen's output,
+// which gives up its point and tet lists. Returns 0 on success.
+int convert_tetgenio(tetgenio& out, dMat& V, iMat& T, iVec& TR,
+    int n_threads = 0);
+
+// The boundary faces of every region of a tet mesh, computed once so that
+// the boundary of any set of regions is a concatenation of face groups.
+// Each row of groups is (region, region on the other side or -1 for the
+// mesh boundary, first row in F, number of faces). Faces are oriented
+// outward of their region, as by igl::boundary_facets.
+struct region_faces
+{
+  iMat F;
+  iMat groups;
+};
+
+// Group the faces of the tets T with regions TX, numbered from 0.
+void build_region_faces(const iMat& T, const iVec& TX, region_faces& faces);
+
+// The boundary faces of the tets in the regions set in mask.
+void visible_faces(const region_faces& faces, const bVec& mask, iMat& F);
+
+// Write a tet mesh in .vtx format, with TX as the only tet attribute when
+// export_tet_info is set. Chunks of lines are formatted on n_threads threads
+// (all cores for 0) and written in order.
+bool write_vtx(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info, int n_threads = 0);
+
+// Binary companion of .vtx, in native (little endian) byte order:
+//
+//   vtxb_header
+//   vertex block at vertex_offset: n_vertices rows of 3 doubles
+//   tet block at tet_offset: n_tets rows of 4 + txn int32, the 4 vertex ids
+//     followed by the tet attributes
+//
+// Both blocks start on a 64 byte boundary so a mapped file can be used in
+// place.
+struct vtxb_header
+{
+  char magic[4];          // "VTXB"
+  uint32_t version;       // 1
+  uint32_t txn;           // attributes per tet
+  uint32_t reserved;
+  uint64_t n_vertices;
+  uint64_t n_tets;
+  uint64_t vertex_offset; // in bytes from the start of the file
+  uint64_t tet_offset;
+};
+
+// Write a tet mesh in .vtxb format, with TX as the only tet attribute when
+// export_tet_info is set.
+bool write_vtxb(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info);
+
+// Write .vtxb when the filename ends with it, .vtx otherwise, the latter on
+// n_threads threads.
+bool write_tet_mesh(const std::string filename, const dMat& V, const iMat& T,
+    const iVec& TX, bool export_tet_info, int n_threads = 0);
+
+class mapped_file;
+
+// A .vtxb file mapped read-only in memory, V and T view its blocks without
+// copying them and stay valid while the view lives.
+class vtxb_view
+{
+public:
+  typedef Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3,
+      Eigen::RowMajor>> vertex_map;
+  typedef Eigen::Map<const Eigen::Matrix<int32_t, Eigen::Dynamic,
+      Eigen::Dynamic, Eigen::RowMajor>> tet_map;
+
+  // Map a file, false if it can not be read or is not a valid .vtxb file.
+  bool open(const std::string filename);
+
+  vertex_map V = vertex_map(nullptr, 0, 3);
+  tet_map T = tet_map(nullptr, 0, 4); // vertex ids then txn attributes
+  int txn = 0;
+
+private:
+  std::shared_ptr<const mapped_file> file;
+};
+
+// Load a .vtxb file into V and T, and its first tet attribute into TX (all
+// 0 when it has none).
+bool read_vtxb(const std::string filename, dMat& V, iMat& T, iVec& TX);
+
+#endif